@@ -0,0 +1,531 @@
+// Benchmark suite for tknzr
+//
+// Measures encode/decode throughput across input sizes, pre-tokenizer speed
+// per SIMD level, vocabulary load time, training time per merge and heap
+// allocations per call. All input is generated from fixed seeds, so runs are
+// offline and repeatable; results are written as JSON for comparing builds.
+//
+// Usage: tknzr_bench [--quick] [--filter SUBSTRING] [--min-time SECONDS] [--out FILE]
+
+#include "tknzr/tknzr.hpp"
+#include "tknzr/stream.hpp"
+#include "counting_allocator.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Results feed this so the optimizer cannot drop the measured calls
+std::atomic<size_t> g_sink{0};
+
+void keep(size_t value) {
+    g_sink.fetch_add(value, std::memory_order_relaxed);
+}
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// ============================================================================
+// Synthetic corpora
+// ============================================================================
+
+// English-like prose with numbers, punctuation, code lines and some
+// non-ASCII text, in roughly the proportions of a web/code training mix.
+// Made-up words from syllables keep the vocabulary of pieces open-ended.
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(uint32_t seed) : rng_(seed) {}
+    
+    std::string make(size_t bytes) {
+        std::string text;
+        text.reserve(bytes + 256);
+        while (text.size() < bytes) {
+            switch (pick(10)) {
+                case 0: code_line(text); break;
+                case 1: unicode_sentence(text); break;
+                default: sentence(text); break;
+            }
+            text += pick(4) == 0 ? "\n\n" : " ";
+        }
+        text.resize(bytes);
+        return text;
+    }
+
+private:
+    size_t pick(size_t n) { return rng_() % n; }
+    
+    void word(std::string& text) {
+        static const char* common[] = {
+            "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "was", "with", "be", "by",
+            "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an",
+            "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been",
+            "if", "more", "when", "will", "would", "who", "so", "no", "tokenizer", "model", "data"};
+        static const char* syllables[] = {
+            "ka", "ter", "on", "pre", "dis", "al", "ing", "tion", "ver", "com", "ex", "ment", "st",
+            "ri", "bo", "lu", "ness", "ma", "qu", "ph", "ough", "ea", "sh", "ly", "un", "re", "der"};
+        if (pick(3) != 0) {
+            text += common[pick(std::size(common))];
+            return;
+        }
+        const size_t count = 1 + pick(4);
+        const size_t start = text.size();
+        for (size_t i = 0; i < count; ++i) text += syllables[pick(std::size(syllables))];
+        if (pick(8) == 0) text[start] = static_cast<char>(text[start] - 'a' + 'A');
+    }
+    
+    void sentence(std::string& text) {
+        const size_t words = 4 + pick(16);
+        for (size_t i = 0; i < words; ++i) {
+            if (i) text += ' ';
+            if (pick(25) == 0) {
+                text += std::to_string(rng_() % 100000);
+            } else {
+                word(text);
+            }
+            if (pick(12) == 0) text += ",;:"[pick(3)];
+            if (pick(40) == 0) text += "'s";
+        }
+        text += ".!?"[pick(3)];
+    }
+    
+    void code_line(std::string& text) {
+        text += std::string(4 * (1 + pick(3)), ' ');
+        text += pick(2) ? "if (" : "for (size_t i = 0; i < ";
+        word(text);
+        text += pick(2) ? ".size(); ++i) {" : " != nullptr) {";
+        text += "\n";
+        text += std::string(8, ' ');
+        text += "result += values[" + std::to_string(pick(64)) + "] * 0x" + std::to_string(pick(9999)) + ";\n";
+    }
+    
+    void unicode_sentence(std::string& text) {
+        static const char* pieces[] = {
+            "café", "naïve", "über", "straße", "число", "данные", "中文", "分词器", "東京", "日本語",
+            "emoji 🙂", "→", "—", "…", "ñandú", "Ελληνικά", "مرحبا", "hello"};
+        const size_t count = 3 + pick(8);
+        for (size_t i = 0; i < count; ++i) {
+            if (i) text += ' ';
+            text += pieces[pick(std::size(pieces))];
+        }
+        text += '.';
+    }
+    
+    std::mt19937 rng_;
+};
+
+std::string base64_encode(std::string_view bytes) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        uint32_t word = static_cast<unsigned char>(bytes[i]) << 16;
+        if (i + 1 < bytes.size()) word |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+        if (i + 2 < bytes.size()) word |= static_cast<unsigned char>(bytes[i + 2]);
+        out += alphabet[word >> 18];
+        out += alphabet[(word >> 12) & 63];
+        out += i + 1 < bytes.size() ? alphabet[(word >> 6) & 63] : '=';
+        out += i + 2 < bytes.size() ? alphabet[word & 63] : '=';
+    }
+    return out;
+}
+
+// The vocabulary in tiktoken's text format, as a cl100k_base.tiktoken would be
+std::string to_tiktoken(const tknzr::Tokenizer& tokenizer) {
+    std::string file;
+    for (tknzr::Token token = 0; token < static_cast<tknzr::Token>(256 + tokenizer.get_merges().size()); ++token) {
+        file += base64_encode(tokenizer.decode({token}));
+        file += ' ';
+        file += std::to_string(token);
+        file += '\n';
+    }
+    return file;
+}
+
+// ============================================================================
+// Measurement and reporting
+// ============================================================================
+
+struct Options {
+    bool quick = false;
+    std::string filter;
+    double min_time = 0.5;
+    std::string out;
+};
+
+struct Result {
+    std::string name;
+    size_t iterations = 0;
+    double ns_per_call = 0;
+    double allocations_per_call = 0;
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+class Suite {
+public:
+    explicit Suite(Options options) : options_(std::move(options)) {}
+    
+    bool enabled(const std::string& name) const {
+        return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+    }
+    
+    // Time fn() over at least min_time seconds (and 3 calls) after a warm-up
+    // call. per_call lists (metric, amount processed per call); each is
+    // reported as a rate per second.
+    template <typename Fn>
+    void run(const std::string& name, std::vector<std::pair<std::string, double>> per_call, Fn&& fn) {
+        if (!enabled(name)) return;
+        fn();
+    
+        Result result;
+        result.name = name;
+        const size_t allocations_before = allocations();
+        const Clock::time_point start = Clock::now();
+        double elapsed = 0;
+        do {
+            fn();
+            ++result.iterations;
+            elapsed = seconds_since(start);
+        } while (elapsed < options_.min_time || result.iterations < 3);
+    
+        const double calls = static_cast<double>(result.iterations);
+        result.ns_per_call = elapsed * 1e9 / calls;
+        result.allocations_per_call = static_cast<double>(allocations() - allocations_before) / calls;
+        for (auto& [metric, amount] : per_call) {
+            result.metrics.emplace_back(metric, amount * calls / elapsed);
+        }
+        report(std::move(result));
+    }
+    
+    // Record a one-off measurement (for work too slow to repeat)
+    void record(const std::string& name, double seconds, size_t allocation_count,
+                std::vector<std::pair<std::string, double>> metrics) {
+        if (!enabled(name)) return;
+        Result result;
+        result.name = name;
+        result.iterations = 1;
+        result.ns_per_call = seconds * 1e9;
+        result.allocations_per_call = static_cast<double>(allocation_count);
+        result.metrics = std::move(metrics);
+        report(std::move(result));
+    }
+    
+    void set_context(const std::string& key, const std::string& value) {
+        context_.emplace_back(key, value);
+    }
+    
+    std::string json() const {
+        std::ostringstream out;
+        out.precision(6);
+        out << "{\n  \"context\": {";
+        for (size_t i = 0; i < context_.size(); ++i) {
+            out << (i ? ",\n" : "\n") << "    \"" << context_[i].first << "\": \"" << context_[i].second << "\"";
+        }
+        out << "\n  },\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result& r = results_[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                << ", \"ns_per_call\": " << std::fixed << r.ns_per_call
+                << ", \"allocations_per_call\": " << r.allocations_per_call;
+            for (const auto& [metric, value] : r.metrics) {
+                out << ", \"" << metric << "\": " << value;
+            }
+            out << std::defaultfloat << "}";
+        }
+        out << "\n  ]\n}\n";
+        return out.str();
+    }
+    
+    const Options& options() const { return options_; }
+
+private:
+    void report(Result result) {
+        // Progress goes to stderr; stdout carries only the JSON
+        std::fprintf(stderr, "%-40s %14.0f ns/call %10.2f allocs/call", result.name.c_str(), result.ns_per_call,
+                     result.allocations_per_call);
+        for (const auto& [metric, value] : result.metrics) {
+            std::fprintf(stderr, "  %s=%.4g", metric.c_str(), value);
+        }
+        std::fprintf(stderr, "\n");
+        results_.push_back(std::move(result));
+    }
+    
+    Options options_;
+    std::vector<std::pair<std::string, std::string>> context_;
+    std::vector<Result> results_;
+};
+
+std::string simd_name(tknzr::SimdLevel level) {
+    switch (level) {
+        case tknzr::SimdLevel::AVX2: return "avx2";
+        case tknzr::SimdLevel::SSE2: return "sse2";
+        case tknzr::SimdLevel::Scalar: break;
+    }
+    return "scalar";
+}
+
+// ============================================================================
+// Benchmarks
+// ============================================================================
+
+struct Input {
+    std::string name;
+    std::string text;
+};
+
+std::vector<Input> make_inputs(CorpusGenerator& generator, bool quick) {
+    std::vector<Input> inputs = {
+        {"chat_64B", generator.make(64)},
+        {"message_1KB", generator.make(1 << 10)},
+        {"page_64KB", generator.make(64 << 10)},
+    };
+    if (!quick) inputs.push_back({"doc_4MB", generator.make(4 << 20)});
+    return inputs;
+}
+
+tknzr::Tokenizer bench_train(Suite& suite, const std::string& corpus, int vocab_size) {
+    tknzr::Tokenizer tokenizer;
+    const std::string_view documents[] = {corpus};
+    const size_t allocations_before = allocations();
+    const Clock::time_point start = Clock::now();
+    tokenizer.train_pieces(documents, vocab_size);
+    const double seconds = seconds_since(start);
+    
+    const double merges = static_cast<double>(tokenizer.get_merges().size());
+    suite.record("train/pieces_" + std::to_string(corpus.size() >> 20) + "MB", seconds,
+                 allocations() - allocations_before,
+                 {{"merges", merges}, {"us_per_merge", seconds * 1e6 / merges},
+                  {"bytes_per_second", static_cast<double>(corpus.size()) / seconds}});
+    return tokenizer;
+}
+
+void bench_load(Suite& suite, const tknzr::Tokenizer& trained) {
+    const std::string tiktoken = to_tiktoken(trained);
+    suite.run("load/tiktoken_text", {}, [&] {
+        tknzr::Tokenizer tokenizer;
+        keep(tokenizer.load_tiktoken(tiktoken));
+    });
+    
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "tknzr_bench.tkc").string();
+    if (trained.save_compiled(path)) {
+        suite.run("load/compiled_mmap", {}, [&] {
+            tknzr::Tokenizer tokenizer;
+            keep(tokenizer.load_compiled(path));
+        });
+        suite.run("load/compiled_mmap_unverified", {}, [&] {
+            tknzr::Tokenizer tokenizer;
+            keep(tokenizer.load_compiled(path, false));
+        });
+        std::filesystem::remove(path);
+    }
+}
+
+void bench_pretokenize(Suite& suite, const std::vector<Input>& inputs) {
+    const tknzr::SimdLevel saved = tknzr::simd_level();
+    const tknzr::PreTokenizer pretokenizer(tknzr::SplitPattern::CL100K);
+    for (auto level : {tknzr::SimdLevel::Scalar, tknzr::SimdLevel::SSE2, tknzr::SimdLevel::AVX2}) {
+        if (tknzr::set_simd_level(level) != level) continue;
+        for (const Input& input : inputs) {
+            suite.run("pretokenize/" + simd_name(level) + "/" + input.name,
+                      {{"bytes_per_second", static_cast<double>(input.text.size())}}, [&] {
+                size_t pieces = 0;
+                pretokenizer.for_each_piece(input.text, [&](std::string_view) { ++pieces; });
+                keep(pieces);
+            });
+        }
+    }
+    tknzr::set_simd_level(saved);
+}
+
+void bench_encode(Suite& suite, const tknzr::Tokenizer& tokenizer, const std::vector<Input>& inputs) {
+    for (const Input& input : inputs) {
+        const double bytes = static_cast<double>(input.text.size());
+        const double tokens = static_cast<double>(tokenizer.count_tokens(input.text));
+        const std::vector<std::pair<std::string, double>> rates = {{"bytes_per_second", bytes},
+                                                                   {"tokens_per_second", tokens}};
+    
+        suite.run("encode/" + input.name, rates, [&] {
+            keep(tokenizer.encode(input.text).size());
+        });
+    
+        std::vector<tknzr::Token> out(static_cast<size_t>(tokens));
+        tknzr::EncodeScratch scratch;
+        suite.run("encode_into/" + input.name, rates, [&] {
+            keep(tokenizer.encode_into(input.text, out, scratch));
+        });
+    
+        suite.run("count_tokens/" + input.name, rates, [&] {
+            keep(tokenizer.count_tokens(input.text));
+        });
+    
+        const tknzr::TokenList encoded = tokenizer.encode(input.text);
+        std::string text;
+        suite.run("decode_into/" + input.name, rates, [&] {
+            tokenizer.decode_into(encoded, text);
+            keep(text.size());
+        });
+    
+        tknzr::StreamDecoder decoder(tokenizer);
+        suite.run("stream_decode/" + input.name, rates, [&] {
+            text.clear();
+            decoder.write(encoded, text);
+            decoder.finish(text);
+            keep(text.size());
+        });
+    }
+}
+
+void bench_cached_encode(Suite& suite, tknzr::Tokenizer tokenizer, const Input& input) {
+    tokenizer.enable_cache();
+    const double bytes = static_cast<double>(input.text.size());
+    suite.run("encode_cached/" + input.name, {{"bytes_per_second", bytes}}, [&] {
+        keep(tokenizer.encode(input.text).size());
+    });
+}
+
+void bench_algorithms(Suite& suite, tknzr::Tokenizer tokenizer, const Input& input) {
+    // A run of one letter is a single piece, the worst case for merging
+    const std::vector<Input> cases = {input, {"run_64KB", std::string(64 << 10, 'a')}};
+    for (auto algorithm : {tknzr::BpeAlgorithm::Heap, tknzr::BpeAlgorithm::Backtracking}) {
+        tokenizer.set_bpe_algorithm(algorithm);
+        if (tokenizer.bpe_algorithm() != algorithm) continue;
+        const std::string name = algorithm == tknzr::BpeAlgorithm::Heap ? "heap" : "backtracking";
+        for (const Input& c : cases) {
+            suite.run("encode_" + name + "/" + c.name, {{"bytes_per_second", static_cast<double>(c.text.size())}}, [&] {
+                keep(tokenizer.encode(c.text).size());
+            });
+        }
+    }
+}
+
+void bench_batch(Suite& suite, const tknzr::Tokenizer& tokenizer, CorpusGenerator& generator) {
+    std::vector<std::string> documents;
+    for (int i = 0; i < 64; ++i) documents.push_back(generator.make(16 << 10));
+    std::vector<std::string_view> views(documents.begin(), documents.end());
+    const double bytes = 64.0 * (16 << 10);
+    
+    suite.run("encode_batch/64x16KB", {{"bytes_per_second", bytes}}, [&] {
+        keep(tokenizer.encode_batch(views).tokens.size());
+    });
+    suite.run("count_tokens_batch/64x16KB", {{"bytes_per_second", bytes}}, [&] {
+        keep(tokenizer.count_tokens_batch(views).size());
+    });
+}
+
+void bench_parallel(Suite& suite, const tknzr::Tokenizer& tokenizer, const Input& input) {
+    // Chunks small enough that every worker gets several
+    const size_t chunk_bytes = std::max<size_t>(input.text.size() / (4 * tokenizer.num_threads()), 4096);
+    suite.run("encode_parallel/" + input.name, {{"bytes_per_second", static_cast<double>(input.text.size())}}, [&] {
+        keep(tokenizer.encode_parallel(input.text, chunk_bytes).size());
+    });
+}
+
+void bench_codec(Suite& suite, const tknzr::Tokenizer& tokenizer, const Input& input) {
+    const tknzr::TokenList tokens = tokenizer.encode(input.text);
+    const double count = static_cast<double>(tokens.size());
+    std::string data;
+    suite.run("compress_tokens/" + input.name, {{"tokens_per_second", count}}, [&] {
+        data.clear();
+        tknzr::compress_tokens(tokens, data);
+        keep(data.size());
+    });
+    
+    const tknzr::SimdLevel saved = tknzr::simd_level();
+    std::vector<uint32_t> decoded;
+    for (auto level : {tknzr::SimdLevel::Scalar, tknzr::SimdLevel::SSE2, tknzr::SimdLevel::AVX2}) {
+        if (tknzr::set_simd_level(level) != level) continue;
+        suite.run("decompress_tokens/" + simd_name(level) + "/" + input.name, {{"tokens_per_second", count}}, [&] {
+            keep(tknzr::decompress_tokens(data, decoded));
+        });
+    }
+    tknzr::set_simd_level(saved);
+    suite.set_context("compressed_bytes_per_token", std::to_string(static_cast<double>(data.size()) / count));
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--quick") {
+            options.quick = true;
+            options.min_time = 0.1;
+        } else if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time" && has_value) {
+            options.min_time = std::atof(argv[++i]);
+        } else if (arg == "--out" && has_value) {
+            options.out = argv[++i];
+        } else {
+            std::cerr << "usage: tknzr_bench [--quick] [--filter SUBSTRING] [--min-time SECONDS] [--out FILE]\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) return 2;
+    Suite suite(options);
+    
+    // A cl100k-sized vocabulary needs a corpus with enough distinct pieces
+    const int vocab_size = options.quick ? 8192 : 100256;
+    const size_t train_bytes = options.quick ? (2u << 20) : (24u << 20);
+
+#ifdef NDEBUG
+    suite.set_context("build", "release");
+#else
+    suite.set_context("build", "debug");
+#endif
+#ifdef __VERSION__
+    suite.set_context("compiler", __VERSION__);
+#endif
+    suite.set_context("simd", simd_name(tknzr::detected_simd_level()));
+    suite.set_context("metrics", tknzr::metrics_enabled() ? "on" : "off");
+    suite.set_context("hardware_threads", std::to_string(std::thread::hardware_concurrency()));
+    suite.set_context("mode", options.quick ? "quick" : "full");
+    suite.set_context("vocab_size_target", std::to_string(vocab_size));
+    
+    CorpusGenerator generator(2024);
+    const std::vector<Input> inputs = make_inputs(generator, options.quick);
+    
+    const std::string train_corpus = CorpusGenerator(7).make(train_bytes);
+    tknzr::Tokenizer tokenizer = bench_train(suite, train_corpus, vocab_size);
+    suite.set_context("vocab_size", std::to_string(tokenizer.vocab_size()));
+    
+    bench_load(suite, tokenizer);
+    bench_pretokenize(suite, inputs);
+    bench_encode(suite, tokenizer, inputs);
+    bench_cached_encode(suite, tokenizer, inputs[2]);
+    bench_algorithms(suite, tokenizer, inputs[2]);
+    bench_batch(suite, tokenizer, generator);
+    bench_parallel(suite, tokenizer, inputs.back());
+    bench_codec(suite, tokenizer, inputs.back());
+    
+    const std::string json = suite.json();
+    if (options.out.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(options.out) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "tknzr/merge_index.hpp"
+#include "tknzr/token_bytes.hpp"
+
+namespace tknzr {
+
+    /**
+     * BPE encoder with a worst-case linear running time
+     *
+     * Every token that BPE can emit is stored in a byte trie (the anchored
+     * goto function of an Aho-Corasick automaton over the vocabulary).
+     * Encoding walks a piece left to right, taking the longest token that
+     * starts at the current position and can follow the previous token,
+     * then shorter prefixes of it, and backtracking when none fits. Whether
+     * two tokens can be adjacent is decided by unwinding their merge trees
+     * against the pair ranks. Positions shown to be dead ends are marked and
+     * never revisited, so a piece costs O(length x longest token) however its
+     * merges are ordered, and the result equals rank-ordered merging.
+     *
+     * Only vocabularies whose merges refer to earlier tokens are supported.
+     */
+    class BacktrackEncoder {
+    public:
+        /**
+         * Build from a frozen vocabulary; the merge index is copied
+         * @return nullptr if some merge refers to itself, a later token or
+         *         an unknown id
+         */
+        static std::shared_ptr<const BacktrackEncoder> build(const MergeIndex& merges,
+                                                             const TokenBytes& token_bytes);
+
+        /**
+         * Encode one non-empty piece
+         * @param piece Bytes to encode
+         * @param tokens Replaced with the piece's tokens
+         * @param dead Working memory for the dead-end bitset, reused across calls
+         */
+        void encode(std::string_view piece, std::vector<Token>& tokens, std::vector<uint64_t>& dead) const;
+
+        /**
+         * Whether BPE ever emits a token (some tokens are always merged further)
+         */
+        bool emittable(Token token) const noexcept {
+            return static_cast<size_t>(token) < lengths_.size() && lengths_[token] != 0;
+        }
+
+    private:
+        struct Edge {
+            uint32_t key;  // parent << 8 | byte, or kNoEdge
+            int32_t child;
+        };
+        static constexpr uint32_t kNoEdge = ~uint32_t{0};
+
+        BacktrackEncoder() = default;
+
+        int32_t child(int32_t node, unsigned char byte) const noexcept;
+        int32_t add_child(int32_t node, unsigned char byte);
+        Token longest_prefix(std::string_view text) const noexcept;
+        bool can_follow(Token left, Token right, Token limit) const noexcept;
+
+        MergeIndex merges_;
+        std::vector<Pair> splits_;        // token -> the pair it merges; (b, b) for byte tokens
+        std::vector<uint32_t> lengths_;   // token -> byte length, 0 if never emitted
+        std::vector<Token> next_prefix_;  // token -> longest emitted proper prefix, or -1
+        std::array<int32_t, 256> root_;   // Children of the trie root, -1 for none
+        std::vector<Edge> edges_;         // Open-addressing table of the other trie edges
+        std::vector<Token> node_tokens_;  // Trie node -> token it spells, or -1
+        size_t mask_ = 0;
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "tknzr/merge_index.hpp"
+
+namespace tknzr {
+
+    /**
+     * Snapshot of encode cache counters
+     */
+    struct CacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;         // Accounted memory currently held
+        size_t budget_bytes = 0;  // Configured memory budget
+
+        double hit_rate() const noexcept {
+            const uint64_t total = hits + misses;
+            return total ? static_cast<double>(hits) / static_cast<double>(total) : 0.0;
+        }
+    };
+
+    /**
+     * Size-bounded piece -> tokens cache, safe for concurrent use
+     *
+     * Keys are hashed onto independent shards, each with its own mutex and
+     * LRU list, so concurrent encoders only contend when they touch the same
+     * shard. Each shard evicts least recently used entries once its share of
+     * the memory budget is exceeded.
+     */
+    class EncodeCache {
+    public:
+        static constexpr size_t kDefaultShards = 64;
+        static constexpr size_t kDefaultMaxPieceBytes = 128;
+
+        /**
+         * @param budget_bytes Approximate upper bound on memory held by cached entries
+         * @param shard_count Number of independently locked shards
+         * @param max_piece_bytes Pieces longer than this are never cached
+         */
+        explicit EncodeCache(size_t budget_bytes,
+                             size_t shard_count = kDefaultShards,
+                             size_t max_piece_bytes = kDefaultMaxPieceBytes);
+
+        EncodeCache(const EncodeCache&) = delete;
+        EncodeCache& operator=(const EncodeCache&) = delete;
+
+        /**
+         * Whether a piece is small enough to be cached
+         */
+        bool cacheable(std::string_view piece) const noexcept {
+            return piece.size() <= max_piece_bytes_;
+        }
+
+        /**
+         * Look up a piece, appending its tokens to out on a hit
+         * @return true on a hit
+         */
+        bool lookup(std::string_view piece, std::vector<Token>& out);
+
+        /**
+         * Insert the tokens for a piece, evicting older entries if needed
+         */
+        void insert(std::string_view piece, std::span<const Token> tokens);
+
+        /**
+         * Drop all entries (counters are kept)
+         */
+        void clear();
+
+        CacheStats stats() const;
+
+        size_t budget_bytes() const noexcept { return budget_bytes_; }
+        size_t max_piece_bytes() const noexcept { return max_piece_bytes_; }
+
+    private:
+        struct Entry {
+            std::string piece;
+            std::vector<Token> tokens;
+            size_t cost;
+        };
+
+        struct alignas(64) Shard {
+            std::mutex mutex;
+            std::list<Entry> lru;  // Most recently used at the front
+            std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+            size_t bytes = 0;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+        };
+
+        Shard& shard_for(std::string_view piece) const noexcept;
+
+        size_t budget_bytes_;
+        size_t shard_budget_;
+        size_t max_piece_bytes_;
+        std::unique_ptr<Shard[]> shards_;
+        size_t shard_count_;
+    };
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace tknzr {
+
+    /**
+     * Read-only memory mapping of a whole file
+     *
+     * Pages are mapped shared, so several processes opening the same file
+     * share one copy in the page cache. On platforms without mmap the file
+     * is read into memory instead.
+     */
+    class MappedFile {
+    public:
+        /**
+         * Map a file read-only
+         * @param path File to map
+         * @return Mapping, or nullptr if the file cannot be opened or mapped
+         */
+        static std::unique_ptr<MappedFile> open(const std::string& path);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* data() const noexcept { return data_; }
+        size_t size() const noexcept { return size_; }
+
+        std::string_view bytes() const noexcept {
+            return std::string_view(reinterpret_cast<const char*>(data_), size_);
+        }
+
+    private:
+        MappedFile() = default;
+
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+        bool mapped_ = false;
+    };
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace tknzr {
+
+    using Token = int;
+    using Pair = std::pair<Token, Token>;
+
+    /**
+     * Pack a token pair into the 64-bit key used by the merge index
+     */
+    constexpr uint64_t pack_pair(Token first, Token second) noexcept {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(first)) << 32) |
+               static_cast<uint32_t>(second);
+    }
+
+    /**
+     * Mix a packed pair into a well distributed 64-bit hash
+     */
+    constexpr uint64_t hash_pair_key(uint64_t key) noexcept {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    /**
+     * Read-only merge index, frozen once at load/train time
+     *
+     * Holds a flat open-addressing table keyed on the packed pair, giving the
+     * rank and resulting token in one probe, plus a dense token -> pair vector
+     * used for decoding. Merge `rank` always produces token `256 + rank`.
+     *
+     * Both arrays are either owned or attached to external memory (such as a
+     * memory-mapped compiled tokenizer) and used in place.
+     */
+    class MergeIndex {
+    public:
+        static constexpr uint64_t kEmptyKey = ~uint64_t{0};
+
+        struct Entry {
+            int32_t rank;
+            Token token;
+        };
+
+        struct Slot {
+            uint64_t key;  // pack_pair(first, second), or kEmptyKey
+            Entry entry;
+        };
+
+        MergeIndex() = default;
+        MergeIndex(const MergeIndex& other);
+        MergeIndex& operator=(const MergeIndex& other);
+        MergeIndex(MergeIndex&&) noexcept = default;
+        MergeIndex& operator=(MergeIndex&&) noexcept = default;
+
+        /**
+         * Rebuild the index from merges listed in rank order.
+         * A pair listed more than once keeps its last (highest) rank.
+         */
+        void build(std::vector<Pair> merges);
+
+        /**
+         * Use a table and pair array stored elsewhere without copying.
+         * The memory must outlive this index (and any copies of it).
+         * @return false if the table size is not a power of two, it has no
+         *         empty slot, or an entry does not match its pair
+         */
+        bool attach(std::span<const Slot> slots, std::span<const Pair> pairs);
+
+        /**
+         * Remove all merges
+         */
+        void clear() noexcept;
+
+        /**
+         * Look up the merge of an adjacent pair
+         * @return Rank and result token, or nullptr if the pair never merges
+         */
+        const Entry* find(Token first, Token second) const noexcept {
+            if (slots_.empty()) return nullptr;
+            const uint64_t key = pack_pair(first, second);
+            for (size_t i = hash_pair_key(key) & mask_;; i = (i + 1) & mask_) {
+                const Slot& slot = slots_[i];
+                if (slot.key == key) return &slot.entry;
+                if (slot.key == kEmptyKey) return nullptr;
+            }
+        }
+
+        /**
+         * Pair a merged token was built from
+         * @return nullptr for byte tokens and unknown ids
+         */
+        const Pair* pair_of(Token token) const noexcept {
+            const size_t i = static_cast<size_t>(token) - 256;
+            return i < pairs_.size() ? &pairs_[i] : nullptr;
+        }
+
+        /**
+         * Merges in rank order (index i is the pair producing token 256 + i)
+         */
+        std::span<const Pair> pairs() const noexcept { return pairs_; }
+
+        /**
+         * Raw open-addressing table (power-of-two size, or empty)
+         */
+        std::span<const Slot> slots() const noexcept { return slots_; }
+
+        size_t size() const noexcept { return pairs_.size(); }
+        bool empty() const noexcept { return pairs_.empty(); }
+
+    private:
+        bool owned() const noexcept { return slots_.data() == slot_storage_.data(); }
+
+        std::vector<Slot> slot_storage_;
+        std::vector<Pair> pair_storage_;
+        std::span<const Slot> slots_;
+        std::span<const Pair> pairs_;
+        size_t mask_ = 0;
+    };
+
+    /**
+     * Read-only view of the merge rules as (token id, pair) entries in token order
+     */
+    class MergesView {
+    public:
+        using value_type = std::pair<Token, Pair>;
+
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = MergesView::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            iterator() = default;
+            iterator(const Pair* pos, Token token) : pos_(pos), token_(token) {}
+
+            value_type operator*() const { return {token_, *pos_}; }
+            iterator& operator++() { ++pos_; ++token_; return *this; }
+            iterator operator++(int) { iterator tmp = *this; ++*this; return tmp; }
+            bool operator==(const iterator& other) const { return pos_ == other.pos_; }
+
+        private:
+            const Pair* pos_ = nullptr;
+            Token token_ = 256;
+        };
+
+        explicit MergesView(std::span<const Pair> pairs) : pairs_(pairs) {}
+
+        iterator begin() const { return {pairs_.data(), 256}; }
+        iterator end() const { return {pairs_.data() + pairs_.size(), 256 + static_cast<Token>(pairs_.size())}; }
+        size_t size() const noexcept { return pairs_.size(); }
+        bool empty() const noexcept { return pairs_.empty(); }
+
+        bool contains(Token token) const noexcept {
+            return token >= 256 && static_cast<size_t>(token - 256) < pairs_.size();
+        }
+
+        /**
+         * Pair for a merged token
+         * @throws std::out_of_range if the token is not a merge
+         */
+        const Pair& at(Token token) const;
+
+    private:
+        std::span<const Pair> pairs_;
+    };
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace tknzr {
+
+    /**
+     * Event counters kept by an instrumented build
+     */
+    enum class Counter {
+        EncodeCalls,    // encode(), encode_into(), count_tokens(), ... (one per call)
+        Pieces,         // Pre-tokenizer pieces merged, by any encode path
+        BytesIn,        // Bytes of those pieces
+        TokensOut,      // Tokens they produced
+        Merges,         // BPE merges applied (cache hits apply none)
+        CacheHits,
+        CacheMisses,
+        ScratchGrowths, // Times an encode scratch buffer had to allocate
+        DecodeCalls,
+        DecodeTokens,
+        BytesOut,       // Bytes produced by decoding
+        Count_,
+    };
+    
+    /**
+     * Stages with a latency histogram
+     * Encode and Decode time every call. Pretokenize, CacheLookup and Merge
+     * time one piece in 16 per thread, since timing every piece would cost
+     * about as much as merging it; their counts are samples, not totals.
+     */
+    enum class Stage {
+        Pretokenize,
+        CacheLookup,
+        Merge,
+        Encode,
+        Decode,
+        Count_,
+    };
+    
+    constexpr size_t kCounterCount = static_cast<size_t>(Counter::Count_);
+    constexpr size_t kStageCount = static_cast<size_t>(Stage::Count_);
+    
+    constexpr std::string_view counter_name(Counter counter) noexcept {
+        constexpr std::string_view names[kCounterCount] = {
+            "encode_calls", "pieces", "bytes_in", "tokens_out", "merges", "cache_hits", "cache_misses",
+            "scratch_growths", "decode_calls", "decode_tokens", "bytes_out"};
+        return names[static_cast<size_t>(counter)];
+    }
+    
+    constexpr std::string_view stage_name(Stage stage) noexcept {
+        constexpr std::string_view names[kStageCount] = {"pretokenize", "cache_lookup", "merge", "encode", "decode"};
+        return names[static_cast<size_t>(stage)];
+    }
+    
+    /**
+     * Latency distribution with power-of-two buckets
+     * Bucket 0 holds 0 ns; bucket i > 0 holds [2^(i-1), 2^i) ns, and the last
+     * bucket everything longer.
+     */
+    struct LatencyHistogram {
+        static constexpr size_t kBuckets = 40;
+    
+        std::array<uint64_t, kBuckets> buckets{};
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+    
+        static constexpr size_t bucket_of(uint64_t ns) noexcept {
+            const size_t bucket = static_cast<size_t>(std::bit_width(ns));
+            return bucket < kBuckets ? bucket : kBuckets - 1;
+        }
+    
+        double mean_ns() const noexcept {
+            return count ? static_cast<double>(total_ns) / static_cast<double>(count) : 0.0;
+        }
+    
+        /**
+         * Upper bound of the bucket holding the q-quantile (0 <= q <= 1)
+         */
+        uint64_t percentile_ns(double q) const noexcept {
+            const double rank = q * static_cast<double>(count);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; ++i) {
+                seen += buckets[i];
+                if (seen > 0 && static_cast<double>(seen) >= rank) return i == 0 ? 0 : uint64_t{1} << i;
+            }
+            return 0;
+        }
+    };
+    
+    /**
+     * Totals over all threads since start or the last reset_metrics()
+     */
+    struct MetricsSnapshot {
+        std::array<uint64_t, kCounterCount> counters{};
+        std::array<LatencyHistogram, kStageCount> stages{};
+    
+        uint64_t operator[](Counter counter) const noexcept { return counters[static_cast<size_t>(counter)]; }
+        const LatencyHistogram& operator[](Stage stage) const noexcept { return stages[static_cast<size_t>(stage)]; }
+    
+        double cache_hit_rate() const noexcept {
+            const uint64_t lookups = (*this)[Counter::CacheHits] + (*this)[Counter::CacheMisses];
+            return lookups ? static_cast<double>((*this)[Counter::CacheHits]) / static_cast<double>(lookups) : 0.0;
+        }
+    };
+    
+    /**
+     * Whether the library was built with -DTKNZR_METRICS=ON
+     * Without it the hot paths carry no instrumentation at all and snapshots
+     * stay zero.
+     */
+    bool metrics_enabled() noexcept;
+    
+    /**
+     * Sum the per-thread counters and histograms
+     * Each thread records into its own shard without atomic read-modify-write
+     * or locks; only taking a snapshot walks the shards. Values of threads
+     * still encoding may be a few events behind.
+     */
+    MetricsSnapshot metrics_snapshot();
+    
+    /**
+     * Start counting from zero
+     */
+    void reset_metrics();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace tknzr {
+
+    /**
+     * Split pattern applied to text before BPE runs on each piece
+     */
+    enum class SplitPattern {
+        None,    // Whole input is a single piece (no pre-tokenization)
+        GPT2,    // GPT-2 / r50k_base pattern
+        CL100K,  // GPT-4 / cl100k_base pattern
+    };
+
+    /**
+     * Hand-written scanner equivalent to the tiktoken split regexes
+     *
+     * GPT2:   's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+     * CL100K: (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}|
+     *         ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+
+     *
+     * Input is UTF-8; invalid bytes are treated as punctuation so every byte
+     * ends up in exactly one piece.
+     */
+    class PreTokenizer {
+    public:
+        explicit PreTokenizer(SplitPattern pattern = SplitPattern::CL100K) : pattern_(pattern) {}
+
+        SplitPattern pattern() const noexcept { return pattern_; }
+
+        /**
+         * Length in bytes of the piece at the start of text
+         * @return 0 only when text is empty
+         */
+        size_t next_piece(std::string_view text) const noexcept;
+
+        /**
+         * Call fn(std::string_view piece) for each piece of text in order
+         */
+        template <typename Fn>
+        void for_each_piece(std::string_view text, Fn&& fn) const {
+            while (!text.empty()) {
+                const size_t length = next_piece(text);
+                fn(text.substr(0, length));
+                text.remove_prefix(length);
+            }
+        }
+
+        /**
+         * First position at or after pos where a piece of text certainly
+         * begins, found without scanning text from the start
+         * An ASCII letter followed by any other ASCII character always ends a
+         * piece under both split patterns, and what follows depends only on
+         * the bytes from there on, so text can be cut at such a position.
+         * @return text.size() if there is none (always, for SplitPattern::None)
+         */
+        size_t boundary_after(std::string_view text, size_t pos) const noexcept;
+
+        /**
+         * Split text into pieces
+         * @return Views into text, in order
+         */
+        std::vector<std::string_view> split(std::string_view text) const;
+
+    private:
+        SplitPattern pattern_;
+    };
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+namespace tknzr {
+
+    /**
+     * Instruction sets the vectorized code paths can use
+     */
+    enum class SimdLevel {
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    /**
+     * Best level the running CPU supports
+     */
+    SimdLevel detected_simd_level() noexcept;
+
+    /**
+     * Level currently in use (the detected one unless overridden)
+     */
+    SimdLevel simd_level() noexcept;
+
+    /**
+     * Override the level for the whole process, e.g. to compare code paths
+     * Requests above what the CPU supports are lowered to the detected level.
+     * @return The level now in use
+     */
+    SimdLevel set_simd_level(SimdLevel level) noexcept;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "tknzr/merge_index.hpp"
+
+namespace tknzr {
+
+    /**
+     * A set of special token strings, or all of them
+     */
+    class SpecialSet {
+    public:
+        SpecialSet() = default;
+        SpecialSet(std::initializer_list<std::string_view> names) : names_(names.begin(), names.end()) {}
+        explicit SpecialSet(std::vector<std::string> names) : names_(std::move(names)) {}
+
+        static SpecialSet all() {
+            SpecialSet set;
+            set.all_ = true;
+            return set;
+        }
+        static SpecialSet none() { return SpecialSet(); }
+
+        bool contains(std::string_view name) const noexcept {
+            if (all_) return true;
+            for (const std::string& n : names_) {
+                if (n == name) return true;
+            }
+            return false;
+        }
+
+    private:
+        bool all_ = false;
+        std::vector<std::string> names_;
+    };
+
+    /**
+     * Registry of special tokens with a multi-pattern matcher
+     *
+     * The strings are compiled into an Aho-Corasick automaton with a full
+     * transition table, so find() examines each byte of the text once no
+     * matter how many special tokens are registered. Bytes that cannot start
+     * a special token are skipped without entering the automaton.
+     */
+    class SpecialTokens {
+    public:
+        struct Match {
+            size_t begin;
+            size_t length;
+            Token token;
+        };
+
+        SpecialTokens();
+
+        /**
+         * Register a special token and recompile the automaton
+         * @return false if text is empty or text or token is already registered
+         */
+        bool add(std::string_view text, Token token);
+
+        /**
+         * Leftmost special token in text at or after from; of several
+         * starting there, the longest
+         */
+        std::optional<Match> find(std::string_view text, size_t from = 0) const noexcept;
+
+        /**
+         * Token of an exact special token string
+         */
+        std::optional<Token> token_of(std::string_view text) const noexcept;
+
+        /**
+         * Registered (text, token) entries in registration order
+         */
+        const std::vector<std::pair<std::string, Token>>& entries() const noexcept { return entries_; }
+
+        size_t size() const noexcept { return entries_.size(); }
+        bool empty() const noexcept { return entries_.empty(); }
+
+    private:
+        struct State {
+            std::array<int32_t, 256> next;
+            int32_t depth = 0;
+            int32_t output = -1;      // Entry spelled by this state, if any
+            int32_t dictionary = -1;  // Nearest proper suffix state with an output
+        };
+
+        void compile();
+
+        std::vector<std::pair<std::string, Token>> entries_;
+        std::vector<State> states_;
+        std::bitset<256> first_bytes_;
+    };
+}
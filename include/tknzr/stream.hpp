@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include "tknzr/tknzr.hpp"
+
+namespace tknzr {
+
+    /**
+     * Incremental encoder for inputs that arrive in chunks
+     *
+     * write() emits the tokens of every piece that later bytes can no longer
+     * change and holds back the rest: the trailing piece together with any
+     * trailing whitespace run (which a later newline can regroup), a few
+     * bytes for contractions, and a UTF-8 character cut off at the chunk
+     * boundary. Feeding a text in chunks of any size produces exactly the
+     * tokens of one encode() call, while only the held-back bytes are kept
+     * between calls. Each write() classifies only its new bytes and rescans
+     * the held-back piece only when they could end it, so a long piece fed
+     * in small chunks costs time linear in its length.
+     *
+     * The tokenizer must outlive the encoder and keep its vocabulary and
+     * split pattern; an encoder must not be used by two threads at once.
+     */
+    class StreamEncoder {
+    public:
+        explicit StreamEncoder(const Tokenizer& tokenizer);
+
+        /**
+         * Feed the next bytes of the input
+         * @param chunk Bytes following everything written so far
+         * @param out Receives the tokens that became final (appended)
+         */
+        void write(std::string_view chunk, TokenList& out);
+
+        /**
+         * Mark the end of the input and emit the held-back tokens
+         * The encoder is then ready for a new input.
+         * @param out Receives the remaining tokens (appended)
+         */
+        void finish(TokenList& out);
+
+        /**
+         * Drop any held-back input without emitting it
+         */
+        void reset() noexcept {
+            pending_.clear();
+            scanned_ = 0;
+            content_end_ = 0;
+            held_ = Held::Nothing;
+        }
+
+        /**
+         * Bytes currently held back
+         */
+        size_t buffered() const noexcept { return pending_.size(); }
+
+    private:
+        // Why write() last stopped short of the end of pending_
+        enum class Held : uint8_t {
+            Nothing,     // Too few bytes left to decide a piece
+            Run,         // The last piece runs to the end
+            Whitespace,  // The next piece reaches into the trailing whitespace
+        };
+
+        void emit(std::string_view piece, TokenList& out);
+
+        const Tokenizer& tokenizer_;
+        PreTokenizer pretokenizer_;
+        EncodeScratch scratch_;
+        std::string pending_;
+        size_t scanned_ = 0;      // Bytes of pending_ already classified
+        size_t content_end_ = 0;  // Just past the last non-whitespace character of pending_
+        Held held_ = Held::Nothing;
+        uint8_t run_class_ = 0;   // Character class ending a held-back Run
+    };
+
+    /**
+     * Incremental decoder that only ever emits complete, valid UTF-8
+     *
+     * A token may end in the middle of a multi-byte character. Such a tail
+     * is carried (at most 3 bytes) until the following tokens complete it.
+     * Each byte that does not start a valid sequence becomes U+FFFD, so the
+     * concatenated output is the same however the tokens are split up.
+     * Every call does work proportional to the bytes it decodes and, once
+     * out has grown, allocates nothing.
+     *
+     * The tokenizer must outlive the decoder and keep its vocabulary.
+     */
+    class StreamDecoder {
+    public:
+        explicit StreamDecoder(const Tokenizer& tokenizer) : tokenizer_(tokenizer) {}
+
+        /**
+         * Decode the next token
+         * @param out Receives the text that became complete (appended)
+         */
+        void write(Token token, std::string& out);
+
+        /**
+         * Decode the next tokens
+         * @param out Receives the text that became complete (appended)
+         */
+        void write(std::span<const Token> tokens, std::string& out);
+
+        /**
+         * Mark the end of the stream; each carried byte becomes U+FFFD
+         * The decoder is then ready for a new stream.
+         */
+        void finish(std::string& out);
+
+        void reset() noexcept { carry_size_ = 0; }
+
+        /**
+         * Bytes of an unfinished character currently carried
+         */
+        size_t buffered() const noexcept { return carry_size_; }
+
+    private:
+        const Tokenizer& tokenizer_;
+        char carry_[4] = {};
+        uint8_t carry_size_ = 0;
+    };
+}
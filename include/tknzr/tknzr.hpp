@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -8,23 +9,137 @@
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <span>
+#include <string_view>
+#include "tknzr/backtrack_encoder.hpp"
+#include "tknzr/encode_cache.hpp"
+#include "tknzr/merge_index.hpp"
+#include "tknzr/metrics.hpp"
+#include "tknzr/pretokenizer.hpp"
+#include "tknzr/simd.hpp"
+#include "tknzr/special_tokens.hpp"
+#include "tknzr/token_bytes.hpp"
+#include "tknzr/token_codec.hpp"
 
 namespace tknzr {
 
-    using Token = int;
-    using Pair = std::pair<Token, Token>;
     using TokenList = std::vector<Token>;
 
     struct PairHash {
         size_t operator()(const Pair& p) const noexcept; 
     };
 
+    class ThreadPool;
+    class MappedFile;
+    class BpeTrainer;
+    class Trainer;
+    class StreamEncoder;
+    class StreamDecoder;
+
+    namespace detail {
+        // Symbol of a word being merged; symbols form an intrusive doubly
+        // linked list over their byte positions and merged-away symbols keep
+        // their slot with len == 0
+        struct Symbol {
+            Token token;
+            int prev;
+            int next;
+            int len;
+        };
+
+        // Candidate merge of adjacent symbols (left, right); len is their
+        // combined length when queued, so stale candidates can be detected
+        struct MergeCandidate {
+            int rank;
+            Token token;
+            int left;
+            int right;
+            int len;
+        };
+    }
+
+    /**
+     * Reusable working memory for Tokenizer::encode_into()
+     * Buffers grow to fit the longest piece seen and are then reused, so
+     * steady-state encoding through one scratch performs no heap allocation.
+     * A scratch must not be used by two threads at once.
+     */
+    struct EncodeScratch {
+        std::vector<detail::Symbol> symbols;
+        std::vector<detail::MergeCandidate> heap;
+        std::vector<detail::MergeCandidate> batch;
+        std::vector<detail::MergeCandidate> pending;
+        std::vector<uint64_t> dead;  // Dead-end positions of the backtracking encoder
+        TokenList word;  // Tokens of the most recently encoded piece
+    };
+
+    /**
+     * Token sequences for a batch of documents, stored as one flat buffer
+     * Document i owns tokens[offsets[i], offsets[i + 1]).
+     */
+    struct BatchEncoding {
+        std::vector<size_t> offsets;  // size() + 1 entries, starting at 0
+        TokenList tokens;
+
+        size_t size() const noexcept { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+        std::span<const Token> operator[](size_t i) const noexcept {
+            return std::span<const Token>(tokens).subspan(offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    };
+
+    /**
+     * Merge engine that turns each piece into tokens
+     */
+    enum class BpeAlgorithm {
+        Heap,          // Rank-ordered merging with a priority queue
+        Backtracking,  // Worst-case linear time, see BacktrackEncoder
+    };
+
+    /**
+     * Which end of the text encode_truncated() keeps
+     */
+    enum class TruncationSide {
+        Head,  // The first tokens
+        Tail,  // The last tokens
+    };
+
+    /**
+     * One window of encode_windows(): tokens[token_begin, token_end) encode
+     * text[byte_begin, byte_end)
+     */
+    struct TokenWindow {
+        size_t byte_begin;
+        size_t byte_end;
+        size_t token_begin;
+        size_t token_end;
+    };
+
+    /**
+     * Overlapping windows over the tokens of one text, stored once
+     */
+    struct WindowedEncoding {
+        TokenList tokens;  // Encoding of the whole text
+        std::vector<TokenWindow> windows;
+
+        size_t size() const noexcept { return windows.size(); }
+
+        std::span<const Token> operator[](size_t i) const noexcept {
+            return std::span<const Token>(tokens).subspan(windows[i].token_begin,
+                                                          windows[i].token_end - windows[i].token_begin);
+        }
+    };
+
     /**
      * Main tokenizer class compatible with GPT API tokenization
      * Uses Byte Pair Encoding (BPE) algorithm
      */
     class Tokenizer {
     public:
+        // Special token ids may lie at most this far past the last BPE token,
+        // which bounds the id table add_special_token() grows to cover them
+        static constexpr Token kMaxSpecialGap = Token{1} << 20;
+
         /**
          * Create a tokenizer with a custom vocabulary size
          * @param vocab_size Target vocabulary size (default 100256 for GPT-4/cl100k_base)
@@ -52,6 +167,37 @@ namespace tknzr {
          */
         bool load_from_tiktoken_binary(const std::vector<uint8_t>& binary_data);
 
+        /**
+         * Load a tiktoken vocabulary such as cl100k_base.tiktoken
+         * Each line is "<base64 token bytes> <rank>". Token ids equal ranks,
+         * so encodings match tiktoken's; the merge pairs are recovered from
+         * the byte strings. The split pattern is left unchanged.
+         * load_from_file() and load_from_base64() also recognize this format.
+         * @param contents The file's contents
+         * @return true if loaded; false, with the tokenizer unchanged, if the
+         *         file is malformed or its ranks are not dense
+         */
+        bool load_tiktoken(std::string_view contents);
+
+        /**
+         * Save the frozen vocabulary as a compiled tokenizer file
+         * The file holds the merge table, rank array and decode byte table in
+         * the layout used at runtime, plus a version and checksum.
+         * @param path Destination file (written atomically via a temporary file)
+         * @return true if written successfully, false otherwise
+         */
+        bool save_compiled(const std::string& path) const;
+
+        /**
+         * Memory-map a compiled tokenizer file and use it in place
+         * Nothing is parsed or copied, and processes mapping the same file share
+         * its pages. load_from_file() also recognizes compiled files.
+         * @param path File written by save_compiled()
+         * @param verify_checksum Verify the payload checksum (reads every page)
+         * @return true if loaded successfully, false otherwise
+         */
+        bool load_compiled(const std::string& path, bool verify_checksum = true);
+
         /**
          * Train tokenizer on text data
          * @param text Training text
@@ -59,12 +205,224 @@ namespace tknzr {
          */
         void train(const std::string& text, int vocab_size);
 
+        /**
+         * Train on pre-tokenized pieces instead of the raw byte stream
+         * Documents are split with the current split pattern and unique pieces
+         * are counted in parallel, then BPE runs over the weighted piece table,
+         * so merges never cross a piece boundary. Uses the batch thread pool.
+         * @param documents Training documents (need not be contiguous)
+         * @param vocab_size Target vocabulary size
+         */
+        void train_pieces(std::span<const std::string_view> documents, int vocab_size);
+
+        /**
+         * Select the split pattern used to pre-tokenize text before BPE
+         * @param pattern SplitPattern::CL100K (default), GPT2, or None to run BPE over the whole input
+         */
+        void set_split_pattern(SplitPattern pattern);
+
+        /**
+         * Get the active split pattern
+         * @return Pattern applied by encode()
+         */
+        SplitPattern split_pattern() const;
+
+        /**
+         * Select the merge engine
+         * Both produce identical tokens. Backtracking bounds the time per
+         * piece by its length times the longest token, which protects against
+         * pathological inputs such as long runs of one character; it needs
+         * merges that only refer to earlier tokens and is rebuilt whenever
+         * the vocabulary changes.
+         * @param algorithm BpeAlgorithm::Heap (default) or BpeAlgorithm::Backtracking
+         */
+        void set_bpe_algorithm(BpeAlgorithm algorithm);
+
+        /**
+         * Get the merge engine in use
+         * @return Heap if Backtracking was requested but the vocabulary does not support it
+         */
+        BpeAlgorithm bpe_algorithm() const;
+
+        /**
+         * Enable the piece -> tokens encode cache
+         * The cache is shared by all threads calling encode() on this tokenizer
+         * and is emptied whenever the vocabulary changes.
+         * @param budget_bytes Approximate memory budget for cached entries
+         */
+        void enable_cache(size_t budget_bytes = 64u << 20);
+
+        /**
+         * Disable and free the encode cache
+         */
+        void disable_cache();
+
+        /**
+         * Get encode cache counters
+         * @return Hit/miss/eviction counts and memory use (all zero when disabled)
+         */
+        CacheStats cache_stats() const;
+
         /**
          * Encode text into tokens
+         * Text is split into pieces by the split pattern and BPE runs on each piece.
          * @param text Input text to encode
          * @return Vector of token IDs
          */
-        TokenList encode(const std::string& text) const;
+        TokenList encode(std::string_view text) const;
+
+        /**
+         * Encode text, recognizing registered special tokens
+         * Special tokens are found in one scan before pre-tokenization, and
+         * the text between them is encoded as usual. A special token in
+         * allowed becomes its id; otherwise one in disallowed is an error,
+         * and any other is encoded as ordinary text.
+         * @param text Input text
+         * @param allowed Special tokens to emit as their ids
+         * @param disallowed Special tokens that must not appear
+         * @throws std::invalid_argument if a disallowed special token is found
+         */
+        TokenList encode_with_special(std::string_view text,
+                                      const SpecialSet& allowed = SpecialSet::all(),
+                                      const SpecialSet& disallowed = SpecialSet::all()) const;
+
+        /**
+         * Register a special token such as "<|endoftext|>"
+         * Special tokens belong to the vocabulary: loading or training a new
+         * one clears them. Compiled files keep them.
+         * @param text The special token's string
+         * @param id Its token id, above every BPE token and less than
+         *           kMaxSpecialGap past the last one
+         * @throws std::invalid_argument if text is empty, id is a BPE token or
+         *         beyond that ceiling, text or id is already registered, or the
+         *         byte table would exceed TokenBytes::kMaxArenaBytes
+         */
+        void add_special_token(std::string_view text, Token id);
+
+        /**
+         * Id of a registered special token
+         */
+        std::optional<Token> special_token(std::string_view text) const;
+
+        /**
+         * Registered special tokens as (text, id), in registration order
+         */
+        std::vector<std::pair<std::string, Token>> special_tokens() const;
+
+        /**
+         * Encode text into a caller-provided buffer without allocating
+         * With the cache disabled (or warm) and a reused scratch, no heap
+         * allocation happens once the scratch has grown to the longest piece.
+         * @param text Input text to encode
+         * @param out Destination; receives the first min(out.size(), result) tokens
+         * @param scratch Working memory reused across calls
+         * @return Number of tokens the full encoding needs; larger than out.size()
+         *         means out was too small and holds only a prefix
+         */
+        size_t encode_into(std::string_view text, std::span<Token> out, EncodeScratch& scratch) const;
+
+        /**
+         * Count the tokens encode() would return without building them
+         * Runs the same merge engine in thread-local scratch, so steady-state
+         * calls allocate nothing.
+         * @param text Input text
+         * @return encode(text).size()
+         */
+        size_t count_tokens(std::string_view text) const;
+
+        /**
+         * Encode at most max_tokens tokens from one end of text
+         * Only as many pieces as needed are merged; the result equals the
+         * first (Head) or last (Tail) max_tokens tokens of encode(text).
+         * @param text Input text
+         * @param max_tokens Token limit
+         * @param side End of the text to keep
+         */
+        TokenList encode_truncated(std::string_view text, size_t max_tokens,
+                                   TruncationSide side = TruncationSide::Head) const;
+
+        /**
+         * Encode text once and cut it into overlapping windows
+         * Windows start on pre-tokenizer piece boundaries and end where the
+         * text before scans alone into the same pieces: after a piece that
+         * does not end in whitespace, or, within a run of whitespace pieces
+         * (which a lookahead such as \s+(?!\S) can split differently once the
+         * following bytes are gone), after one that rescans unchanged. So each
+         * window equals encoding its byte range alone. A window holds at most
+         * window tokens, and the next one starts at the last piece boundary
+         * within stride tokens of its start and no later than its end (or the
+         * first one after, if there is none). Only a single piece longer than
+         * a window is split mid-piece.
+         * @param text Input text
+         * @param window Maximum tokens per window (at least 1)
+         * @param stride Maximum tokens between window starts (at least 1)
+         * @return Tokens of the whole text plus the windows over them
+         * @throws std::invalid_argument if window or stride is 0
+         */
+        WindowedEncoding encode_windows(std::string_view text, size_t window, size_t stride) const;
+
+        /**
+         * Set the number of threads used by the batch APIs
+         * @param threads Worker count including the calling thread; 0 uses a shared
+         *                process-wide pool sized to the hardware concurrency
+         */
+        void set_num_threads(size_t threads);
+
+        /**
+         * Get the number of threads used by the batch APIs
+         * @return Worker count of the active pool
+         */
+        size_t num_threads() const;
+
+        /**
+         * Encode many documents in parallel
+         * Output is identical to calling encode() on each document in order.
+         * @param texts Input documents
+         * @return Ragged token buffer, one entry per document in input order
+         */
+        BatchEncoding encode_batch(std::span<const std::string_view> texts) const;
+
+        /**
+         * Encode one large text in parallel
+         * The text is cut into chunks of about chunk_bytes where a
+         * pre-tokenizer piece certainly begins (see PreTokenizer::boundary_after),
+         * the chunks are encoded on the batch thread pool and their tokens
+         * joined, so the result always equals encode(text). Text with no such
+         * position, or split with SplitPattern::None, is encoded as one chunk.
+         * @param text Input text
+         * @param chunk_bytes Target chunk size (at least 1)
+         */
+        TokenList encode_parallel(std::string_view text, size_t chunk_bytes = 1u << 20) const;
+
+        /**
+         * Bytes per token id needed to store this vocabulary's output
+         * @return 2 if every BPE and special token id fits in uint16_t, else 4
+         */
+        size_t token_width() const;
+
+        /**
+         * Encode text into narrow token ids, e.g. for storage
+         * The ids equal encode(text); pick the overload with token_width().
+         * @param text Input text
+         * @param out Replaced with the token ids
+         * @throws std::length_error (uint16_t overload) if token_width() is 4
+         */
+        void encode_compact(std::string_view text, std::vector<uint16_t>& out) const;
+        void encode_compact(std::string_view text, std::vector<uint32_t>& out) const;
+
+        /**
+         * Count the tokens of many documents in parallel
+         * @param texts Input documents
+         * @return count_tokens() of each document, in input order
+         */
+        std::vector<size_t> count_tokens_batch(std::span<const std::string_view> texts) const;
+
+        /**
+         * Decode many token sequences in parallel
+         * @param batch Token sequences, e.g. from encode_batch()
+         * @return Decoded text per sequence, in input order
+         */
+        std::vector<std::string> decode_batch(const BatchEncoding& batch) const;
 
         /**
          * Decode tokens back to text
@@ -73,6 +431,16 @@ namespace tknzr {
          */
         std::string decode(const TokenList& tokens) const;
 
+        /**
+         * Decode tokens into a caller-provided string, reusing its capacity
+         * Unknown token ids decode to nothing.
+         * @param tokens Token IDs to decode
+         * @param out Replaced with the decoded bytes
+         */
+        void decode_into(std::span<const Token> tokens, std::string& out) const;
+        void decode_into(std::span<const uint16_t> tokens, std::string& out) const;
+        void decode_into(std::span<const uint32_t> tokens, std::string& out) const;
+
         /**
          * Get vocabulary size
          * @return Number of tokens in vocabulary
@@ -81,24 +449,46 @@ namespace tknzr {
 
         /**
          * Get the merge rules (vocabulary)
-         * @return Map from token ID to pair of tokens it represents
+         * @return View from token ID to pair of tokens it represents
          */
-        const std::unordered_map<Token, Pair>& get_merges() const;
+        MergesView get_merges() const;
 
     private:
-        std::unordered_map<Token, Pair> merges_;  // token_id -> (token1, token2)
-        std::unordered_map<Pair, Token, PairHash> merge_ranks_;  // (token1, token2) -> rank
+        friend class Trainer;
+        friend class StreamEncoder;
+        friend class StreamDecoder;
+
+        MergeIndex merges_;  // (token1, token2) -> rank, token_id -> (token1, token2)
+        TokenBytes token_bytes_;  // token_id -> full byte expansion
+        PreTokenizer pretokenizer_;
+        std::shared_ptr<EncodeCache> cache_;  // Shared by copies with the same vocabulary
+        std::shared_ptr<ThreadPool> pool_;    // nullptr uses ThreadPool::shared()
+        std::shared_ptr<const MappedFile> mapping_;  // Backs merges_/token_bytes_ after load_compiled()
+        std::shared_ptr<const SpecialTokens> specials_;  // Replaced, never mutated, when tokens are added
+        std::shared_ptr<const BacktrackEncoder> backtrack_;  // Set while the backtracking engine is in use
+        BpeAlgorithm algorithm_ = BpeAlgorithm::Heap;  // Requested engine
+        std::array<Token, 256> byte_tokens_;  // Byte -> its base token; identity unless a tiktoken file reorders them
         int vocab_size_;
         
         // Helper functions
+        bool freeze_vocabulary(std::vector<Pair> merges, std::span<const uint8_t> base_bytes = {});
+        void learn_merges(BpeTrainer& trainer, int vocab_size);
+        void reset_cache();
+        void reset_encoder();
+        static bool is_compiled(std::string_view data);
+        static bool is_tiktoken(std::string_view data);
+        static EncodeScratch& thread_scratch();
+        void encode_append(std::string_view text, TokenList& tokens) const;
+        ThreadPool& thread_pool() const;
         std::vector<int> bytes_to_unicode() const;
-        std::vector<int> text_to_bytes(const std::string& text) const;
-        std::string bytes_to_text(const std::vector<int>& bytes) const;
-        std::vector<Token> bpe_encode(const std::vector<int>& word_bytes) const;
-        std::vector<int> bpe_decode(const std::vector<Token>& tokens) const;
+        void bpe_encode(std::string_view piece, EncodeScratch& scratch) const;
+        void merge_by_rank(std::string_view piece, EncodeScratch& scratch) const;
+        std::span<const Token> encode_piece(std::string_view piece, EncodeScratch& scratch) const;
+        template <typename Sink>
+        void encode_pieces(std::string_view text, EncodeScratch& scratch, Sink&& sink) const;
+        template <typename T>
+        void decode_ids(std::span<const T> tokens, std::string& out) const;
         std::vector<Pair> get_word_pairs(const std::vector<int>& word) const;
-        Pair get_most_common_pair(const std::vector<int>& word) const;
-        std::vector<int> apply_merge(const std::vector<int>& word, const Pair& pair, Token new_token) const;
     };
 
     // Legacy functions (kept for backward compatibility, but deprecated)
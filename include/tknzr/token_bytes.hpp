@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tknzr/merge_index.hpp"
+
+namespace tknzr {
+
+    /**
+     * Flat table of each token's full byte expansion
+     *
+     * All expansions live in one contiguous arena with an (offset, length)
+     * entry per token id, so decoding a token is a bounds check and a memcpy
+     * instead of a recursive walk through the merge pairs. Like MergeIndex,
+     * the arrays are either owned or attached to external memory.
+     */
+    class TokenBytes {
+    public:
+        struct Span {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        // Cap on the total size of all expansions; real vocabularies need
+        // around a megabyte, while merges that keep doubling a token would
+        // otherwise grow the arena exponentially
+        static constexpr size_t kMaxArenaBytes = size_t{1} << 28;
+
+        TokenBytes() = default;
+        TokenBytes(const TokenBytes& other);
+        TokenBytes& operator=(const TokenBytes& other);
+        TokenBytes(TokenBytes&&) noexcept = default;
+        TokenBytes& operator=(TokenBytes&&) noexcept = default;
+
+        /**
+         * Rebuild from the 256 byte tokens plus every merge in the index.
+         * Merges that refer to unknown tokens expand those parts to nothing;
+         * a merge that (indirectly) refers to itself expands to nothing.
+         * @param base_bytes Byte of each token below 256; empty for token == byte
+         * @return false, leaving the table unchanged, if the expansions would
+         *         total more than kMaxArenaBytes
+         */
+        bool build(const MergeIndex& merges, std::span<const uint8_t> base_bytes = {});
+
+        /**
+         * Use an arena and span table stored elsewhere without copying.
+         * The memory must outlive this table (and any copies of it).
+         * @return false if a span points outside the arena
+         */
+        bool attach(std::string_view arena, std::span<const Span> spans);
+
+        /**
+         * Set the expansion of one token, growing the table to cover it
+         * Attached memory is first copied into owned storage.
+         * @return false, leaving the table unchanged, if the arena would
+         *         exceed kMaxArenaBytes
+         */
+        bool set(Token token, std::string_view bytes);
+
+        /**
+         * Byte expansion of a token
+         * @return Empty view for ids outside the table
+         */
+        std::string_view operator[](Token token) const noexcept {
+            if (static_cast<size_t>(token) >= spans_.size()) return {};
+            const Span& span = spans_[token];
+            return arena_.substr(span.offset, span.length);
+        }
+
+        /**
+         * Number of token ids covered by the table
+         */
+        size_t size() const noexcept { return spans_.size(); }
+
+        std::string_view arena() const noexcept { return arena_; }
+        std::span<const Span> spans() const noexcept { return spans_; }
+
+    private:
+        bool owned() const noexcept { return spans_.data() == span_storage_.data(); }
+
+        std::string arena_storage_;
+        std::vector<Span> span_storage_;
+        std::string_view arena_;
+        std::span<const Span> spans_;
+    };
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tknzr/merge_index.hpp"
+
+namespace tknzr {
+
+    /**
+     * Bit-packed token stream codec
+     *
+     * A stream is the token count as a LEB128 varint, then blocks of 128
+     * tokens. Each block stores one byte with the bit width of its largest
+     * id, then every id in that many bits: ids are dealt round-robin onto
+     * four lanes of 32-bit words, so decoding unpacks four ids per vector
+     * step (see set_simd_level()). The final partial block is a plain
+     * LSB-first bit stream. cl100k ids take at most 17 bits and GPT-2 ids
+     * 16, against 32 for a TokenList.
+     */
+
+    /**
+     * Append the encoded form of tokens to out
+     * @throws std::invalid_argument if a token id is negative
+     */
+    void compress_tokens(std::span<const Token> tokens, std::string& out);
+    void compress_tokens(std::span<const uint16_t> tokens, std::string& out);
+    void compress_tokens(std::span<const uint32_t> tokens, std::string& out);
+
+    /**
+     * Decode one stream written by compress_tokens()
+     * @param data Encoded bytes; anything after the stream is ignored
+     * @param tokens Replaced with the decoded ids
+     * @return Bytes of data the stream took, or 0 if it is truncated,
+     *         malformed, or holds an id the output type cannot represent
+     */
+    size_t decompress_tokens(std::string_view data, std::vector<Token>& tokens);
+    size_t decompress_tokens(std::string_view data, std::vector<uint16_t>& tokens);
+    size_t decompress_tokens(std::string_view data, std::vector<uint32_t>& tokens);
+}
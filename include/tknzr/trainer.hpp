@@ -0,0 +1,173 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tknzr/tknzr.hpp"
+
+namespace tknzr {
+
+    class PieceCounter;
+    class BpeTrainer;
+    struct PieceTable;
+
+    /**
+     * Streaming BPE trainer with bounded memory
+     *
+     * Input is pre-tokenized as it arrives and only the counts of unique
+     * pieces are kept. When their estimated size exceeds the memory limit
+     * they are written to a sorted run in the temp directory and dropped;
+     * train() merges the runs back into one weighted piece table, so the
+     * corpus itself never has to fit in memory. Results are identical to
+     * Tokenizer::train_pieces() over the same documents.
+     *
+     * Training can be checkpointed: a checkpoint holds the weighted piece
+     * table and the merges so far, and is written in the background while
+     * merging continues. Merge selection has no random state (see
+     * BpeTrainer for the tie-break), so a run resumed from a checkpoint
+     * produces exactly the merges of an uninterrupted run.
+     *
+     * A Trainer is not thread safe; counting runs on its own thread pool.
+     */
+    class Trainer {
+    public:
+        /**
+         * @param pattern Split pattern used to pre-tokenize (copied to the trained tokenizer)
+         * @param memory_limit Piece-count memory before spilling to disk, in bytes
+         */
+        explicit Trainer(SplitPattern pattern = SplitPattern::CL100K, size_t memory_limit = size_t{1} << 30);
+        ~Trainer();
+
+        Trainer(const Trainer&) = delete;
+        Trainer& operator=(const Trainer&) = delete;
+
+        void set_memory_limit(size_t bytes) noexcept { memory_limit_ = bytes; }
+        size_t memory_limit() const noexcept { return memory_limit_; }
+
+        /**
+         * Directory for spill files (defaults to the system temp directory)
+         */
+        void set_temp_directory(const std::string& path) { temp_directory_ = path; }
+
+        /**
+         * Set the number of counting threads (0 = shared process-wide pool)
+         */
+        void set_num_threads(size_t threads);
+
+        /**
+         * Count a file; it is memory-mapped, so it may be larger than RAM
+         * @return false if the file cannot be opened
+         */
+        bool add_file(const std::string& path);
+
+        /**
+         * Count one document; pieces never span two add_chunk() calls
+         */
+        void add_chunk(std::string_view text);
+
+        /**
+         * Count several documents at once, spreading them over the threads
+         */
+        void add_chunks(std::span<const std::string_view> documents);
+
+        /**
+         * Count every document in [first, last) (anything convertible to
+         * std::string_view). Documents are copied into bounded batches, so
+         * the iterator may hand out temporaries.
+         */
+        template <typename Iterator, typename Sentinel>
+        void add_documents(Iterator first, Sentinel last) {
+            std::vector<std::string> batch;
+            size_t batch_bytes = 0;
+            for (; first != last; ++first) {
+                batch.emplace_back(std::string_view(*first));
+                batch_bytes += batch.back().size();
+                if (batch_bytes >= kDocumentBatchBytes) {
+                    add_batch(batch);
+                    batch.clear();
+                    batch_bytes = 0;
+                }
+            }
+            add_batch(batch);
+        }
+
+        /**
+         * Learn merges from everything added so far and load them into tokenizer
+         * The tokenizer also takes this trainer's split pattern.
+         * @param tokenizer Tokenizer to replace the vocabulary of
+         * @param vocab_size Target vocabulary size
+         */
+        void train(Tokenizer& tokenizer, int vocab_size);
+
+        /**
+         * Write a checkpoint every interval merges during train(), and once
+         * more when it finishes. Each write goes to a temporary file that is
+         * renamed over path; a write still running when the next one is due
+         * delays that one instead of stalling training.
+         * @param path Checkpoint file
+         * @param interval Merges between checkpoints (0 = only the final one)
+         */
+        void set_checkpoint(const std::string& path, size_t interval);
+
+        /**
+         * Restore a checkpoint; the next train() continues from its merges
+         * Replaces all input added so far, and input cannot be added after.
+         * @return false if the file is missing, corrupt or from another version
+         */
+        bool resume(const std::string& path);
+
+        /**
+         * Checkpoints successfully written so far
+         */
+        size_t checkpoints_written() const noexcept { return checkpoints_written_; }
+
+        /**
+         * Unique pieces currently held in memory
+         */
+        size_t unique_pieces() const;
+
+        /**
+         * Sorted runs spilled to disk so far
+         */
+        size_t spill_count() const noexcept { return runs_.size(); }
+
+    private:
+        friend class Tokenizer;  // train_pieces() lends its pool
+
+        static constexpr size_t kDocumentBatchBytes = size_t{8} << 20;
+
+        void add_batch(const std::vector<std::string>& documents) {
+            std::vector<std::string_view> views(documents.begin(), documents.end());
+            add_chunks(views);
+        }
+
+        void count_chunks(const std::vector<std::string_view>& chunks);
+        std::shared_ptr<const PieceTable> build_table();
+        void checkpoint(const BpeTrainer& trainer, bool final);
+        void finish_checkpoint();
+        static bool write_checkpoint(const std::string& path, const PieceTable& table,
+                                     const std::vector<Pair>& merges, SplitPattern pattern);
+        void spill();
+        void remove_runs();
+        ThreadPool& thread_pool() const;
+
+        SplitPattern pattern_;
+        size_t memory_limit_;
+        std::string temp_directory_;
+        std::unique_ptr<PieceCounter> counter_;
+        std::shared_ptr<ThreadPool> pool_;
+        std::vector<std::string> runs_;
+
+        std::shared_ptr<const PieceTable> table_;  // Set by train() and resume()
+        std::vector<Pair> resumed_merges_;
+        bool resumed_ = false;
+        std::string checkpoint_path_;
+        size_t checkpoint_interval_ = 0;
+        size_t checkpoints_written_ = 0;
+        std::future<bool> pending_checkpoint_;
+    };
+}
@@ -0,0 +1,179 @@
+#include "ascii_scan.hpp"
+#include "tknzr/simd.hpp"
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TKNZR_X86_64 1
+#include <immintrin.h>
+#endif
+
+#if defined(TKNZR_X86_64) && defined(__GNUC__)
+#define TKNZR_TARGET_AVX2 __attribute__((target("avx2")))
+#define TKNZR_HAVE_AVX2 1
+#elif defined(TKNZR_X86_64) && defined(__AVX2__)
+#define TKNZR_TARGET_AVX2
+#define TKNZR_HAVE_AVX2 1
+#endif
+
+namespace tknzr {
+
+// ============================================================================
+// ASCII class runs
+// ============================================================================
+//
+// Each class is a byte range test done as one signed compare: adding
+// 0x80 - lo maps [lo, lo + n) onto [-128, -128 + n), and every byte >= 0x80
+// lands outside it, so non-ASCII bytes never extend a run.
+//
+//   Letter  (c | 0x20) in ['a', 'z']
+//   Number  c in ['0', '9']
+//   Space   c == ' ' or c in ['\t', '\r']
+//   Other   ASCII and none of the above
+
+namespace {
+
+using unicode::CharClass;
+
+using RunEnd = size_t (*)(std::string_view, size_t, CharClass) noexcept;
+
+size_t run_end_scalar(std::string_view text, size_t pos, CharClass cls) noexcept {
+    while (pos < text.size()) {
+        const unsigned char c = static_cast<unsigned char>(text[pos]);
+        if (c >= 0x80 || unicode::classify_ascii(c) != cls) break;
+        ++pos;
+    }
+    return pos;
+}
+
+#ifdef TKNZR_X86_64
+
+inline __m128i in_range_sse2(__m128i v, char lo, char n) noexcept {
+    const __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + n)));
+}
+
+// Bit i set when byte i belongs to cls
+inline uint32_t class_mask_sse2(__m128i v, CharClass cls) noexcept {
+    const __m128i letter = in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26);
+    const __m128i number = in_range_sse2(v, '0', 10);
+    const __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), in_range_sse2(v, '\t', 5));
+    __m128i mask;
+    switch (cls) {
+        case CharClass::Letter: mask = letter; break;
+        case CharClass::Number: mask = number; break;
+        case CharClass::Space: mask = space; break;
+        default: {
+            const __m128i ascii = _mm_cmpgt_epi8(v, _mm_set1_epi8(-1));
+            mask = _mm_andnot_si128(_mm_or_si128(_mm_or_si128(letter, number), space), ascii);
+            break;
+        }
+    }
+    return static_cast<uint32_t>(_mm_movemask_epi8(mask));
+}
+
+size_t run_end_sse2(std::string_view text, size_t pos, CharClass cls) noexcept {
+    const char* data = text.data();
+    while (pos + 16 <= text.size()) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const uint32_t outside = ~class_mask_sse2(v, cls) & 0xFFFFu;
+        if (outside != 0) return pos + static_cast<size_t>(std::countr_zero(outside));
+        pos += 16;
+    }
+    return run_end_scalar(text, pos, cls);
+}
+
+#ifdef TKNZR_HAVE_AVX2
+
+TKNZR_TARGET_AVX2
+inline __m256i in_range_avx2(__m256i v, char lo, char n) noexcept {
+    const __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + n)), shifted);
+}
+
+TKNZR_TARGET_AVX2
+inline uint32_t class_mask_avx2(__m256i v, CharClass cls) noexcept {
+    const __m256i letter = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26);
+    const __m256i number = in_range_avx2(v, '0', 10);
+    const __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), in_range_avx2(v, '\t', 5));
+    __m256i mask;
+    switch (cls) {
+        case CharClass::Letter: mask = letter; break;
+        case CharClass::Number: mask = number; break;
+        case CharClass::Space: mask = space; break;
+        default: {
+            const __m256i ascii = _mm256_cmpgt_epi8(v, _mm256_set1_epi8(-1));
+            mask = _mm256_andnot_si256(_mm256_or_si256(_mm256_or_si256(letter, number), space), ascii);
+            break;
+        }
+    }
+    return static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+}
+
+TKNZR_TARGET_AVX2
+size_t run_end_avx2(std::string_view text, size_t pos, CharClass cls) noexcept {
+    const char* data = text.data();
+    while (pos + 32 <= text.size()) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const uint32_t outside = ~class_mask_avx2(v, cls);
+        if (outside != 0) return pos + static_cast<size_t>(std::countr_zero(outside));
+        pos += 32;
+    }
+    return run_end_sse2(text, pos, cls);
+}
+
+#endif // TKNZR_HAVE_AVX2
+#endif // TKNZR_X86_64
+
+SimdLevel detect() noexcept {
+#if defined(TKNZR_HAVE_AVX2) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+#elif defined(TKNZR_HAVE_AVX2)
+    return SimdLevel::AVX2;
+#endif
+#ifdef TKNZR_X86_64
+    return SimdLevel::SSE2;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+RunEnd select(SimdLevel level) noexcept {
+    switch (level) {
+#ifdef TKNZR_HAVE_AVX2
+        case SimdLevel::AVX2: return run_end_avx2;
+#endif
+#ifdef TKNZR_X86_64
+        case SimdLevel::SSE2: return run_end_sse2;
+#endif
+        default: return run_end_scalar;
+    }
+}
+
+const SimdLevel g_detected = detect();
+std::atomic<SimdLevel> g_level{g_detected};
+std::atomic<RunEnd> g_run_end{select(g_detected)};
+
+} // namespace
+
+SimdLevel detected_simd_level() noexcept {
+    return g_detected;
+}
+
+SimdLevel simd_level() noexcept {
+    return g_level.load(std::memory_order_relaxed);
+}
+
+SimdLevel set_simd_level(SimdLevel level) noexcept {
+    if (level > g_detected) level = g_detected;
+    g_level.store(level, std::memory_order_relaxed);
+    g_run_end.store(select(level), std::memory_order_relaxed);
+    return level;
+}
+
+size_t unicode::ascii_run_end(std::string_view text, size_t pos, CharClass cls) noexcept {
+    return g_run_end.load(std::memory_order_relaxed)(text, pos, cls);
+}
+
+} // namespace tknzr
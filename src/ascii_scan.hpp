@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include "unicode.hpp"
+
+namespace tknzr::unicode {
+
+    /**
+     * End of the run of ASCII characters of class cls starting at pos
+     * Stops at the first byte of another class or the first non-ASCII byte,
+     * which the caller then decodes. Scans 16 or 32 bytes per step when the
+     * CPU allows (see set_simd_level()).
+     */
+    size_t ascii_run_end(std::string_view text, size_t pos, CharClass cls) noexcept;
+
+}
@@ -0,0 +1,179 @@
+#include "tknzr/backtrack_encoder.hpp"
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace tknzr {
+
+namespace {
+
+constexpr Token kNoLimit = std::numeric_limits<Token>::max();
+
+// Trie nodes are packed with a byte into 32-bit edge keys, which must not
+// collide with kNoEdge
+constexpr size_t kMaxNodes = (size_t{1} << 24) - 1;
+
+} // namespace
+
+std::shared_ptr<const BacktrackEncoder> BacktrackEncoder::build(const MergeIndex& merges,
+                                                                const TokenBytes& token_bytes) {
+    const size_t count = 256 + merges.size();
+    std::shared_ptr<BacktrackEncoder> encoder(new BacktrackEncoder());
+    BacktrackEncoder& e = *encoder;
+    e.merges_ = merges;
+    e.splits_.resize(count);
+    e.lengths_.assign(count, 0);
+    e.next_prefix_.assign(count, -1);
+    
+    for (Token b = 0; b < 256; ++b) {
+        e.splits_[b] = {b, b};
+        e.lengths_[b] = 1;
+    }
+    
+    // A merged token is emitted only if its parts are, the pair still maps
+    // to it, and BPE over its bytes keeps the two parts apart until the end;
+    // checking in id order finds the parts already classified
+    size_t total_bytes = 256;
+    for (size_t id = 256; id < count; ++id) {
+        const Token token = static_cast<Token>(id);
+        const Pair& pair = *merges.pair_of(token);
+        if (pair.first < 0 || pair.first >= token || pair.second < 0 || pair.second >= token) {
+            return nullptr;
+        }
+        e.splits_[id] = pair;
+        const MergeIndex::Entry* merge = merges.find(pair.first, pair.second);
+        if (e.lengths_[pair.first] && e.lengths_[pair.second] && merge && merge->token == token &&
+            e.can_follow(pair.first, pair.second, token)) {
+            e.lengths_[id] = e.lengths_[pair.first] + e.lengths_[pair.second];
+            total_bytes += e.lengths_[id];
+        }
+    }
+    
+    // Every emitted token becomes a trie path; edges out of the root are a
+    // dense array, the rest share one hash table sized for the worst case
+    e.root_.fill(-1);
+    const size_t capacity = std::bit_ceil(total_bytes * 2);
+    e.edges_.assign(capacity, Edge{kNoEdge, -1});
+    e.mask_ = capacity - 1;
+    e.node_tokens_.assign(1, -1);
+    for (size_t id = 0; id < count; ++id) {
+        if (!e.lengths_[id]) continue;
+        int32_t node = 0;
+        for (unsigned char c : token_bytes[static_cast<Token>(id)]) {
+            int32_t next = e.child(node, c);
+            if (next < 0) {
+                if (e.node_tokens_.size() >= kMaxNodes) return nullptr;
+                next = e.add_child(node, c);
+            }
+            node = next;
+        }
+        e.node_tokens_[node] = static_cast<Token>(id);
+    }
+    
+    for (size_t id = 256; id < count; ++id) {
+        if (!e.lengths_[id]) continue;
+        const std::string_view bytes = token_bytes[static_cast<Token>(id)];
+        int32_t node = 0;
+        for (size_t i = 0; i + 1 < bytes.size(); ++i) {
+            node = e.child(node, static_cast<unsigned char>(bytes[i]));
+            if (e.node_tokens_[node] >= 0) e.next_prefix_[id] = e.node_tokens_[node];
+        }
+    }
+    return encoder;
+}
+
+int32_t BacktrackEncoder::child(int32_t node, unsigned char byte) const noexcept {
+    if (node == 0) return root_[byte];
+    const uint32_t key = static_cast<uint32_t>(node) << 8 | byte;
+    for (size_t i = hash_pair_key(key) & mask_;; i = (i + 1) & mask_) {
+        if (edges_[i].key == key) return edges_[i].child;
+        if (edges_[i].key == kNoEdge) return -1;
+    }
+}
+
+int32_t BacktrackEncoder::add_child(int32_t node, unsigned char byte) {
+    const int32_t next = static_cast<int32_t>(node_tokens_.size());
+    node_tokens_.push_back(-1);
+    if (node == 0) {
+        root_[byte] = next;
+        return next;
+    }
+    const uint32_t key = static_cast<uint32_t>(node) << 8 | byte;
+    size_t i = hash_pair_key(key) & mask_;
+    while (edges_[i].key != kNoEdge) i = (i + 1) & mask_;
+    edges_[i] = {key, next};
+    return next;
+}
+
+Token BacktrackEncoder::longest_prefix(std::string_view text) const noexcept {
+    Token best = -1;
+    int32_t node = 0;
+    for (unsigned char c : text) {
+        node = child(node, c);
+        if (node < 0) break;
+        if (node_tokens_[node] >= 0) best = node_tokens_[node];
+    }
+    return best;
+}
+
+bool BacktrackEncoder::can_follow(Token left, Token right, Token limit) const noexcept {
+    // Undo the merges on both sides of the boundary, latest first. limit is
+    // the rank a merge across the boundary has to beat: one of lower rank
+    // would have fired before the side being undone was complete.
+    for (;;) {
+        const MergeIndex::Entry* merge = merges_.find(left, right);
+        if (merge && merge->token < limit) return false;
+        if (left > right) {
+            limit = left;
+            left = splits_[left].second;
+            if (left == limit) {  // A byte token: only the right side is left
+                limit = right + 1;
+                right = splits_[right].first;
+                if (right + 1 == limit) return true;
+            }
+        } else {
+            limit = right + 1;
+            right = splits_[right].first;
+            if (right + 1 == limit) {
+                limit = left;
+                left = splits_[left].second;
+                if (left == limit) return true;
+            }
+        }
+    }
+}
+
+void BacktrackEncoder::encode(std::string_view piece, std::vector<Token>& tokens,
+                              std::vector<uint64_t>& dead) const {
+    tokens.clear();
+    dead.assign(piece.size() / 64 + 1, 0);
+    auto is_dead = [&](size_t pos) { return (dead[pos / 64] >> (pos % 64)) & 1; };
+    
+    size_t pos = 0;
+    Token next = longest_prefix(piece);
+    while (pos < piece.size()) {
+        const Token last = tokens.empty() ? -1 : tokens.back();
+        for (Token token = next;;) {
+            const size_t end = pos + lengths_[token];
+            if (!is_dead(end) && (last < 0 || can_follow(last, token, kNoLimit))) {
+                tokens.push_back(token);
+                pos = end;
+                next = longest_prefix(piece.substr(pos));
+                break;
+            }
+            if (next_prefix_[token] >= 0) {
+                token = next_prefix_[token];
+                continue;
+            }
+            // Nothing fits after last: this position is a dead end, so give
+            // last up and retry its shorter prefixes
+            dead[pos / 64] |= uint64_t{1} << (pos % 64);
+            tokens.pop_back();
+            pos -= lengths_[last];
+            next = last;
+            break;
+        }
+    }
+}
+
+} // namespace tknzr
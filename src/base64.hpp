@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tknzr {
+
+    constexpr uint8_t kBase64Invalid = 0xFF;
+    
+    constexpr std::array<uint8_t, 256> make_base64_table() {
+        std::array<uint8_t, 256> table{};
+        table.fill(kBase64Invalid);
+        constexpr std::string_view alphabet =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (size_t i = 0; i < alphabet.size(); ++i) {
+            table[static_cast<unsigned char>(alphabet[i])] = static_cast<uint8_t>(i);
+        }
+        return table;
+    }
+    
+    // Sextet value of each base64 character, or kBase64Invalid
+    inline constexpr std::array<uint8_t, 256> kBase64Table = make_base64_table();
+    
+    // Decode standard base64 with optional '=' padding and append to out.
+    // Four characters become three bytes per step: the sextets are OR-ed
+    // into one word, so a single test of bit 7 catches any invalid character.
+    // Returns false (out unchanged) on a bad character or length.
+    inline bool base64_decode_append(std::string_view in, std::string& out) {
+        if (!in.empty() && in.back() == '=') in.remove_suffix(1);
+        if (!in.empty() && in.back() == '=') in.remove_suffix(1);
+        const size_t tail = in.size() % 4;
+        if (tail == 1) return false;
+    
+        const size_t start = out.size();
+        out.resize(start + in.size() / 4 * 3 + (tail ? tail - 1 : 0));
+        const auto* src = reinterpret_cast<const unsigned char*>(in.data());
+        char* dest = out.data() + start;
+        const auto sextet = [&](size_t i) { return static_cast<uint32_t>(kBase64Table[src[i]]); };
+    
+        uint32_t invalid = 0;
+        size_t i = 0;
+        for (; i + 4 <= in.size(); i += 4) {
+            const uint32_t a = sextet(i), b = sextet(i + 1), c = sextet(i + 2), d = sextet(i + 3);
+            invalid |= a | b | c | d;
+            const uint32_t word = (a << 18) | (b << 12) | (c << 6) | d;
+            dest[0] = static_cast<char>(word >> 16);
+            dest[1] = static_cast<char>(word >> 8);
+            dest[2] = static_cast<char>(word);
+            dest += 3;
+        }
+        if (tail) {
+            const uint32_t a = sextet(i), b = sextet(i + 1), c = tail == 3 ? sextet(i + 2) : 0;
+            invalid |= a | b | c;
+            const uint32_t word = (a << 18) | (b << 12) | (c << 6);
+            dest[0] = static_cast<char>(word >> 16);
+            if (tail == 3) dest[1] = static_cast<char>(word >> 8);
+        }
+    
+        if (invalid & 0x80) {
+            out.resize(start);
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,147 @@
+#include "bpe_trainer.hpp"
+#include <algorithm>
+
+namespace tknzr {
+
+namespace {
+
+Pair unpack_pair(uint64_t key) noexcept {
+    return {static_cast<Token>(key >> 32), static_cast<Token>(key & 0xffffffffu)};
+}
+
+// Max-heap order: highest count, then smallest (first, second)
+struct HeapLess {
+    template <typename Entry>
+    bool operator()(const Entry& a, const Entry& b) const noexcept {
+        if (a.count != b.count) return a.count < b.count;
+        return a.key > b.key;
+    }
+};
+
+} // namespace
+
+void BpeTrainer::add_word(std::string_view bytes, uint64_t weight) {
+    if (bytes.empty() || weight == 0) return;
+    const uint32_t word = static_cast<uint32_t>(weights_.size());
+    weights_.push_back(weight);
+    
+    const uint32_t start = static_cast<uint32_t>(symbols_.size());
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        const uint32_t pos = start + static_cast<uint32_t>(i);
+        symbols_.push_back(static_cast<unsigned char>(bytes[i]));
+        prev_.push_back(i == 0 ? kNone : pos - 1);
+        next_.push_back(i + 1 == bytes.size() ? kNone : pos + 1);
+        word_of_.push_back(word);
+    }
+}
+
+void BpeTrainer::prepare() {
+    prepared_ = true;
+    for (uint32_t pos = 0; pos < symbols_.size(); ++pos) {
+        if (next_[pos] != kNone) {
+            const int64_t weight = static_cast<int64_t>(weights_[word_of_[pos]]);
+            add_count(pack_pair(symbols_[pos], symbols_[next_[pos]]), weight, pos);
+        }
+    }
+    heap_.reserve(pairs_.size());
+    for (const auto& [key, stats] : pairs_) {
+        heap_.push_back({stats.count, key});
+    }
+    std::make_heap(heap_.begin(), heap_.end(), HeapLess());
+}
+
+void BpeTrainer::add_count(uint64_t key, int64_t delta, uint32_t position) {
+    if (delta > 0) {
+        PairStats& stats = pairs_[key];
+        stats.count += delta;
+        stats.positions.push_back(position);
+        if (prepared_) grown_.push_back(key);
+        return;
+    }
+    
+    auto it = pairs_.find(key);
+    if (it == pairs_.end()) return;
+    it->second.count += delta;
+    if (it->second.count <= 0) {
+        pairs_.erase(it); // No live occurrence is left, so its positions are all stale
+    }
+}
+
+void BpeTrainer::push(uint64_t key, int64_t count) {
+    heap_.push_back({count, key});
+    std::push_heap(heap_.begin(), heap_.end(), HeapLess());
+}
+
+std::optional<Pair> BpeTrainer::merge_next() {
+    if (!prepared_) prepare();
+    
+    while (!heap_.empty()) {
+        std::pop_heap(heap_.begin(), heap_.end(), HeapLess());
+        const HeapEntry top = heap_.back();
+        heap_.pop_back();
+        
+        auto it = pairs_.find(top.key);
+        if (it == pairs_.end()) continue;  // Already merged or no longer occurs
+        const int64_t count = it->second.count;
+        if (count != top.count) {
+            // Counts that grew were pushed again when they grew, so only a
+            // shrunken count needs re-queueing at its current value
+            if (count < top.count) push(top.key, count);
+            continue;
+        }
+        
+        const Pair pair = unpack_pair(top.key);
+        merge(pair);
+        return pair;
+    }
+    return std::nullopt;
+}
+
+void BpeTrainer::merge(const Pair& pair) {
+    if (!prepared_) prepare();
+    
+    const Token new_token = static_cast<Token>(256 + merges_.size());
+    merges_.push_back(pair);
+    
+    const uint64_t key = pack_pair(pair.first, pair.second);
+    auto it = pairs_.find(key);
+    if (it == pairs_.end()) return;
+    std::vector<uint32_t> positions = std::move(it->second.positions);
+    pairs_.erase(it);
+    
+    // Left to right within each word, so overlapping runs merge greedily
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+    
+    grown_.clear();
+    for (uint32_t pos : positions) {
+        const uint32_t right = next_[pos];
+        if (symbols_[pos] != pair.first || right == kNone || symbols_[right] != pair.second) {
+            continue; // Stale: merged away or changed since it was indexed
+        }
+        
+        const int64_t weight = static_cast<int64_t>(weights_[word_of_[pos]]);
+        const uint32_t before = prev_[pos];
+        const uint32_t after = next_[right];
+        
+        if (before != kNone) add_count(pack_pair(symbols_[before], pair.first), -weight, before);
+        if (after != kNone) add_count(pack_pair(pair.second, symbols_[after]), -weight, right);
+        
+        symbols_[pos] = new_token;
+        symbols_[right] = kDead;
+        next_[pos] = after;
+        if (after != kNone) prev_[after] = pos;
+        
+        if (before != kNone) add_count(pack_pair(symbols_[before], new_token), weight, before);
+        if (after != kNone) add_count(pack_pair(new_token, symbols_[after]), weight, pos);
+    }
+    
+    std::sort(grown_.begin(), grown_.end());
+    grown_.erase(std::unique(grown_.begin(), grown_.end()), grown_.end());
+    for (uint64_t grown : grown_) {
+        auto stats = pairs_.find(grown);
+        if (stats != pairs_.end()) push(grown, stats->second.count);
+    }
+}
+
+} // namespace tknzr
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "tknzr/merge_index.hpp"
+
+namespace tknzr {
+
+    /**
+     * Incremental BPE trainer over a set of weighted words
+     *
+     * Pair counts are computed once. Each merge then visits only the
+     * positions where the merged pair occurs (via a pair -> positions index)
+     * and adjusts the counts of the neighbouring pairs it destroys and
+     * creates. The best pair is taken from a max-heap with lazy invalidation:
+     * entries are pushed whenever a count grows and checked against the live
+     * count when popped.
+     *
+     * Tie-breaking is deterministic: the highest count wins, and equal counts
+     * go to the pair with the smallest first token id, then the smallest
+     * second token id. Pairs are counted at every adjacent position, so a run
+     * "aaa" counts (a, a) twice, matching the original trainer.
+     */
+    class BpeTrainer {
+    public:
+        /**
+         * Add a word (a sequence that merges never cross) with a weight
+         * Must be called before the first merge.
+         */
+        void add_word(std::string_view bytes, uint64_t weight = 1);
+
+        /**
+         * Choose the best pair, merge it everywhere and record it
+         * The new token id is 256 + number of merges so far.
+         * @return The merged pair, or nothing once no pair occurs any more
+         */
+        std::optional<Pair> merge_next();
+
+        /**
+         * Merge a given pair everywhere and record it (used to replay merges)
+         */
+        void merge(const Pair& pair);
+
+        /**
+         * Merges so far, in rank order
+         */
+        const std::vector<Pair>& merges() const noexcept { return merges_; }
+
+        size_t word_count() const noexcept { return weights_.size(); }
+
+    private:
+        static constexpr uint32_t kNone = ~uint32_t{0};
+        static constexpr Token kDead = -1;
+
+        struct PairStats {
+            int64_t count = 0;
+            std::vector<uint32_t> positions;  // Left positions; may be stale
+        };
+
+        struct HeapEntry {
+            int64_t count;
+            uint64_t key;
+        };
+
+        void prepare();
+        void add_count(uint64_t key, int64_t delta, uint32_t position);
+        void push(uint64_t key, int64_t count);
+
+        std::vector<Token> symbols_;
+        std::vector<uint32_t> prev_;
+        std::vector<uint32_t> next_;
+        std::vector<uint32_t> word_of_;
+        std::vector<uint64_t> weights_;
+
+        std::unordered_map<uint64_t, PairStats> pairs_;
+        std::vector<HeapEntry> heap_;
+        std::vector<uint64_t> grown_;  // Keys whose count grew during a merge
+        std::vector<Pair> merges_;
+        bool prepared_ = false;
+    };
+}
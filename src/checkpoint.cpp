@@ -0,0 +1,164 @@
+#include "tknzr/trainer.hpp"
+#include "tknzr/mapped_file.hpp"
+#include "checksum.hpp"
+#include "piece_counter.hpp"
+#include "piece_table.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace tknzr {
+
+// ============================================================================
+// Training checkpoints
+// ============================================================================
+//
+// A checkpoint is a fixed header followed by, in native byte order:
+//
+//   counts   uint64_t[piece_count]   piece weights
+//   merges   Pair[merge_count]       merges so far, in rank order
+//   lengths  uint32_t[piece_count]   piece lengths
+//   arena    char[arena_bytes]       concatenated pieces, in byte order
+//
+// The piece table never changes once training starts, so the merges are the
+// only progress recorded; resuming replays them.
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'K', 'N', 'Z', 'R', 'C', 'K', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// Tie-break rule the merges were chosen with; bumped if it ever changes, as
+// replaying old merges would then diverge from a fresh run
+constexpr uint32_t kTieBreak = 1;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t checksum;      // checksum64 of every byte after the header
+    uint64_t file_size;
+    uint32_t split_pattern;
+    uint32_t tie_break;
+    uint64_t piece_count;
+    uint64_t arena_bytes;
+    uint64_t merge_count;
+};
+
+static_assert(sizeof(CheckpointHeader) % 8 == 0);
+static_assert(sizeof(Pair) == 2 * sizeof(Token));
+
+// Write a section and feed it to the running checksum
+template <typename T>
+void write_section(std::ofstream& out, Checksum64& checksum, const T* data, size_t count) {
+    if (count == 0) return;
+    const size_t bytes = count * sizeof(T);
+    checksum.update(reinterpret_cast<const uint8_t*>(data), bytes);
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+}
+
+// Copy count values from the payload cursor, failing if it would overrun
+template <typename T>
+bool take(std::string_view& payload, std::vector<T>& out, uint64_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (count > payload.size() / sizeof(T)) return false;
+    out.resize(count);
+    if (count > 0) std::memcpy(out.data(), payload.data(), count * sizeof(T));
+    payload.remove_prefix(count * sizeof(T));
+    return true;
+}
+
+// Pairs are stored as two Tokens each; std::pair is not trivially copyable
+bool take(std::string_view& payload, std::vector<Pair>& out, uint64_t count) {
+    std::vector<Token> tokens;
+    if (count > payload.size() / (2 * sizeof(Token)) || !take(payload, tokens, 2 * count)) return false;
+    out.resize(count);
+    for (size_t i = 0; i < count; ++i) out[i] = {tokens[2 * i], tokens[2 * i + 1]};
+    return true;
+}
+
+} // namespace
+
+bool Trainer::write_checkpoint(const std::string& path, const PieceTable& table,
+                               const std::vector<Pair>& merges, SplitPattern pattern) {
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrderMark;
+    header.split_pattern = static_cast<uint32_t>(pattern);
+    header.tie_break = kTieBreak;
+    header.piece_count = table.size();
+    header.arena_bytes = table.arena.size();
+    header.merge_count = merges.size();
+    
+    header.file_size = sizeof(header) + table.size() * (sizeof(uint64_t) + sizeof(uint32_t)) +
+                       merges.size() * sizeof(Pair) + table.arena.size();
+    
+    // Sections go straight from the table to the file, so a snapshot never
+    // holds a second copy of the pieces. The header is rewritten with the
+    // checksum at the end. Writing to a temporary name and renaming keeps the
+    // previous checkpoint intact if the process dies mid-write.
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        Checksum64 checksum(header.file_size - sizeof(header));
+        write_section(out, checksum, table.counts.data(), table.counts.size());
+        write_section(out, checksum, merges.data(), merges.size());
+        write_section(out, checksum, table.lengths.data(), table.lengths.size());
+        write_section(out, checksum, table.arena.data(), table.arena.size());
+        header.checksum = checksum.finish();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.flush();
+        if (!out) return false;
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool Trainer::resume(const std::string& path) {
+    auto file = MappedFile::open(path);
+    if (!file || file->size() < sizeof(CheckpointHeader)) return false;
+    
+    CheckpointHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion ||
+        header.byte_order != kByteOrderMark ||
+        header.tie_break != kTieBreak ||
+        header.file_size != file->size() ||
+        header.split_pattern > static_cast<uint32_t>(SplitPattern::CL100K)) {
+        return false;
+    }
+    std::string_view payload = file->bytes().substr(sizeof(header));
+    if (checksum64(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()) != header.checksum) {
+        return false;
+    }
+    
+    auto table = std::make_shared<PieceTable>();
+    std::vector<Pair> merges;
+    if (!take(payload, table->counts, header.piece_count) ||
+        !take(payload, merges, header.merge_count) ||
+        !take(payload, table->lengths, header.piece_count) ||
+        payload.size() != header.arena_bytes) {
+        return false;
+    }
+    uint64_t total = 0;
+    for (uint32_t length : table->lengths) total += length;
+    if (total != header.arena_bytes) return false;
+    table->arena.assign(payload);
+    
+    finish_checkpoint();
+    remove_runs();
+    pattern_ = static_cast<SplitPattern>(header.split_pattern);
+    counter_ = std::make_unique<PieceCounter>(pattern_);
+    table_ = std::move(table);
+    resumed_merges_ = std::move(merges);
+    resumed_ = true;
+    return true;
+}
+
+} // namespace tknzr
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace tknzr {
+
+    // Word-at-a-time multiplicative hash; not cryptographic, only meant to
+    // catch truncated or corrupted files. The total size is part of the seed,
+    // so it must be known up front; update() may then be fed in any pieces.
+    class Checksum64 {
+    public:
+        explicit Checksum64(uint64_t total_size) noexcept : hash_(0xcbf29ce484222325ULL ^ total_size) {}
+
+        void update(const uint8_t* data, size_t size) noexcept {
+            // Top up a word left partial by the previous call
+            while (pending_ > 0 && pending_ < 8 && size > 0) {
+                buffer_[pending_++] = *data++;
+                --size;
+            }
+            if (pending_ == 8) {
+                mix(buffer_);
+                pending_ = 0;
+            }
+            for (; size >= 8; data += 8, size -= 8) mix(data);
+            std::memcpy(buffer_ + pending_, data, size);
+            pending_ += size;
+        }
+
+        uint64_t finish() const noexcept {
+            uint64_t tail = 0;
+            std::memcpy(&tail, buffer_, pending_);
+            const uint64_t hash = (hash_ ^ tail) * kPrime;
+            return hash ^ (hash >> 32);
+        }
+
+    private:
+        static constexpr uint64_t kPrime = 0x9e3779b97f4a7c15ULL;
+
+        void mix(const uint8_t* bytes) noexcept {
+            uint64_t word;
+            std::memcpy(&word, bytes, 8);
+            hash_ = (hash_ ^ word) * kPrime;
+            hash_ ^= hash_ >> 29;
+        }
+
+        uint64_t hash_;
+        uint8_t buffer_[8] = {};
+        size_t pending_ = 0;
+    };
+
+    inline uint64_t checksum64(const uint8_t* data, size_t size) noexcept {
+        Checksum64 checksum(size);
+        checksum.update(data, size);
+        return checksum.finish();
+    }
+}
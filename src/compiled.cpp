@@ -0,0 +1,197 @@
+#include "tknzr/tknzr.hpp"
+#include "tknzr/mapped_file.hpp"
+#include "checksum.hpp"
+#include <array>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace tknzr {
+
+// ============================================================================
+// Compiled tokenizer format
+// ============================================================================
+//
+// A compiled file is a fixed header followed by sections, each aligned to 64
+// bytes, in native byte order:
+//
+//   slots   MergeIndex::Slot[slot_count]   open-addressing pair table
+//   pairs   Pair[merge_count]              rank -> pair
+//   spans   TokenBytes::Span[span_count]   token -> (offset, length); ids below
+//                                          256 are single bytes in any order,
+//                                          ids past the merges special tokens
+//   arena   char[arena_bytes]              concatenated token bytes
+//
+// Loading maps the file and points MergeIndex/TokenBytes straight at the
+// sections, so nothing is parsed or copied and processes share the pages.
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'K', 'N', 'Z', 'R', 'C', 'V', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr size_t kAlignment = 64;
+constexpr size_t kHeaderSize = 128;  // Header padded so sections start aligned
+
+struct CompiledHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t checksum;      // checksum64 of every byte after the header
+    uint64_t file_size;
+    int64_t vocab_size;
+    uint32_t split_pattern;
+    uint32_t reserved;
+    uint64_t merge_count;
+    uint64_t slot_count;
+    uint64_t span_count;
+    uint64_t arena_bytes;
+    uint64_t slots_offset;
+    uint64_t pairs_offset;
+    uint64_t spans_offset;
+    uint64_t arena_offset;
+};
+
+static_assert(sizeof(CompiledHeader) % 8 == 0);
+static_assert(sizeof(CompiledHeader) <= kHeaderSize);
+static_assert(std::is_trivially_copyable_v<MergeIndex::Slot>);
+static_assert(std::is_trivially_copyable_v<TokenBytes::Span>);
+static_assert(sizeof(Pair) == 2 * sizeof(Token));
+
+size_t align_up(size_t value) noexcept {
+    return (value + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+// Append a section to the payload, returning its file offset
+template <typename T>
+uint64_t append_section(std::string& payload, const T* data, size_t count) {
+    payload.resize(align_up(kHeaderSize + payload.size()) - kHeaderSize);
+    const uint64_t offset = kHeaderSize + payload.size();
+    if (count > 0) {
+        payload.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+    }
+    return offset;
+}
+
+template <typename T>
+bool section_in_bounds(const CompiledHeader& header, uint64_t offset, uint64_t count) {
+    return offset % alignof(T) == 0 && offset >= kHeaderSize && offset <= header.file_size &&
+           count <= (header.file_size - offset) / sizeof(T);
+}
+
+} // namespace
+
+bool Tokenizer::save_compiled(const std::string& path) const {
+    const std::span<const MergeIndex::Slot> slots = merges_.slots();
+    const std::span<const Pair> pairs = merges_.pairs();
+    const std::span<const TokenBytes::Span> spans = token_bytes_.spans();
+    const std::string_view arena = token_bytes_.arena();
+    
+    CompiledHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrderMark;
+    header.vocab_size = vocab_size_;
+    header.split_pattern = static_cast<uint32_t>(split_pattern());
+    header.merge_count = pairs.size();
+    header.slot_count = slots.size();
+    header.span_count = spans.size();
+    header.arena_bytes = arena.size();
+    
+    std::string payload;
+    header.slots_offset = append_section(payload, slots.data(), slots.size());
+    header.pairs_offset = append_section(payload, pairs.data(), pairs.size());
+    header.spans_offset = append_section(payload, spans.data(), spans.size());
+    header.arena_offset = append_section(payload, arena.data(), arena.size());
+    header.file_size = kHeaderSize + payload.size();
+    header.checksum = checksum64(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+    
+    char head[kHeaderSize] = {};
+    std::memcpy(head, &header, sizeof(header));
+    
+    // Write to a temporary name and rename, so readers never map a partial file
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(head, sizeof(head));
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!out) return false;
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool Tokenizer::load_compiled(const std::string& path, bool verify_checksum) {
+    std::shared_ptr<const MappedFile> file = MappedFile::open(path);
+    if (!file || file->size() < kHeaderSize) return false;
+    
+    CompiledHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion ||
+        header.byte_order != kByteOrderMark ||
+        header.file_size != file->size() ||
+        header.split_pattern > static_cast<uint32_t>(SplitPattern::CL100K)) {
+        return false;
+    }
+    if (!section_in_bounds<MergeIndex::Slot>(header, header.slots_offset, header.slot_count) ||
+        !section_in_bounds<Pair>(header, header.pairs_offset, header.merge_count) ||
+        !section_in_bounds<TokenBytes::Span>(header, header.spans_offset, header.span_count) ||
+        !section_in_bounds<char>(header, header.arena_offset, header.arena_bytes)) {
+        return false;
+    }
+    // Every byte and merged token needs a span
+    if (header.span_count < 256 + header.merge_count) return false;
+    if (verify_checksum &&
+        checksum64(file->data() + kHeaderSize, file->size() - kHeaderSize) != header.checksum) {
+        return false;
+    }
+    
+    const uint8_t* base = file->data();
+    MergeIndex merges;
+    TokenBytes token_bytes;
+    if (!merges.attach({reinterpret_cast<const MergeIndex::Slot*>(base + header.slots_offset), header.slot_count},
+                       {reinterpret_cast<const Pair*>(base + header.pairs_offset), header.merge_count}) ||
+        !token_bytes.attach({reinterpret_cast<const char*>(base + header.arena_offset), header.arena_bytes},
+                            {reinterpret_cast<const TokenBytes::Span*>(base + header.spans_offset), header.span_count})) {
+        return false;
+    }
+    
+    // The first 256 ids are the bytes, not necessarily in byte order
+    std::array<Token, 256> byte_tokens;
+    std::bitset<256> seen;
+    for (Token token = 0; token < 256; ++token) {
+        const std::string_view bytes = token_bytes[token];
+        if (bytes.size() != 1 || seen.test(static_cast<unsigned char>(bytes[0]))) return false;
+        seen.set(static_cast<unsigned char>(bytes[0]));
+        byte_tokens[static_cast<unsigned char>(bytes[0])] = token;
+    }
+    
+    // Ids past the merges with an expansion are the special tokens
+    std::shared_ptr<SpecialTokens> specials;
+    for (size_t id = 256 + header.merge_count; id < header.span_count; ++id) {
+        const std::string_view text = token_bytes[static_cast<Token>(id)];
+        if (text.empty()) continue;
+        if (!specials) specials = std::make_shared<SpecialTokens>();
+        if (!specials->add(text, static_cast<Token>(id))) return false;
+    }
+    
+    merges_ = std::move(merges);
+    token_bytes_ = std::move(token_bytes);
+    byte_tokens_ = byte_tokens;
+    mapping_ = std::move(file);
+    specials_ = std::move(specials);
+    vocab_size_ = static_cast<int>(header.vocab_size);
+    set_split_pattern(static_cast<SplitPattern>(header.split_pattern));
+    reset_cache();
+    reset_encoder();
+    return true;
+}
+
+bool Tokenizer::is_compiled(std::string_view data) {
+    return data.size() >= sizeof(kMagic) && std::memcmp(data.data(), kMagic, sizeof(kMagic)) == 0;
+}
+
+} // namespace tknzr
@@ -0,0 +1,97 @@
+#include "tknzr/encode_cache.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace tknzr {
+
+namespace {
+
+// Rough per-entry overhead of the list node, index node and bucket
+constexpr size_t kEntryOverhead = 96;
+
+size_t entry_cost(std::string_view piece, size_t token_count) noexcept {
+    return kEntryOverhead + piece.size() + token_count * sizeof(Token);
+}
+
+} // namespace
+
+EncodeCache::EncodeCache(size_t budget_bytes, size_t shard_count, size_t max_piece_bytes)
+    : budget_bytes_(budget_bytes),
+      max_piece_bytes_(max_piece_bytes),
+      shard_count_(std::max<size_t>(shard_count, 1)) {
+    shards_ = std::make_unique<Shard[]>(shard_count_);
+    shard_budget_ = budget_bytes_ / shard_count_;
+}
+
+EncodeCache::Shard& EncodeCache::shard_for(std::string_view piece) const noexcept {
+    // High bits of a 64-bit remix pick the shard, so the per-shard map still
+    // sees well spread low bits even where size_t is 32 bits
+    const uint64_t hash = hash_pair_key(std::hash<std::string_view>()(piece));
+    return shards_[(hash >> 32) % shard_count_];
+}
+
+bool EncodeCache::lookup(std::string_view piece, std::vector<Token>& out) {
+    Shard& shard = shard_for(piece);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    auto it = shard.index.find(piece);
+    if (it == shard.index.end()) {
+        ++shard.misses;
+        return false;
+    }
+    ++shard.hits;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    const std::vector<Token>& tokens = it->second->tokens;
+    out.insert(out.end(), tokens.begin(), tokens.end());
+    return true;
+}
+
+void EncodeCache::insert(std::string_view piece, std::span<const Token> tokens) {
+    const size_t cost = entry_cost(piece, tokens.size());
+    if (!cacheable(piece) || cost > shard_budget_) return;
+    
+    Shard& shard = shard_for(piece);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    if (shard.index.find(piece) != shard.index.end()) {
+        return; // Another thread got here first
+    }
+    while (!shard.lru.empty() && shard.bytes + cost > shard_budget_) {
+        const Entry& victim = shard.lru.back();
+        shard.bytes -= victim.cost;
+        shard.index.erase(victim.piece);
+        shard.lru.pop_back();
+        ++shard.evictions;
+    }
+    
+    shard.lru.push_front({std::string(piece), std::vector<Token>(tokens.begin(), tokens.end()), cost});
+    shard.index.emplace(shard.lru.front().piece, shard.lru.begin());
+    shard.bytes += cost;
+}
+
+void EncodeCache::clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+CacheStats EncodeCache::stats() const {
+    CacheStats stats;
+    stats.budget_bytes = budget_bytes_;
+    for (size_t i = 0; i < shard_count_; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.entries += shard.index.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+
+} // namespace tknzr
@@ -0,0 +1,61 @@
+#include "tknzr/mapped_file.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TKNZR_HAVE_MMAP 1
+#else
+#include <fstream>
+#endif
+
+namespace tknzr {
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    
+#ifdef TKNZR_HAVE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    file->size_ = static_cast<size_t>(st.st_size);
+    if (file->size_ > 0) {
+        void* addr = ::mmap(nullptr, file->size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return nullptr;
+        }
+        file->data_ = static_cast<const uint8_t*>(addr);
+        file->mapped_ = true;
+    }
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) return nullptr;
+    file->size_ = static_cast<size_t>(in.tellg());
+    in.seekg(0, std::ios::beg);
+    uint8_t* buffer = new uint8_t[file->size_ ? file->size_ : 1];
+    in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(file->size_));
+    file->data_ = buffer;
+    if (!in) return nullptr;
+#endif
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef TKNZR_HAVE_MMAP
+    if (mapped_) {
+        ::munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#else
+    delete[] data_;
+#endif
+}
+
+} // namespace tknzr
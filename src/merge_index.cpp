@@ -0,0 +1,99 @@
+#include "tknzr/merge_index.hpp"
+#include <bit>
+#include <stdexcept>
+
+namespace tknzr {
+
+MergeIndex::MergeIndex(const MergeIndex& other) {
+    *this = other;
+}
+
+MergeIndex& MergeIndex::operator=(const MergeIndex& other) {
+    if (this == &other) return *this;
+    slot_storage_ = other.slot_storage_;
+    pair_storage_ = other.pair_storage_;
+    mask_ = other.mask_;
+    if (other.owned()) {
+        slots_ = slot_storage_;
+        pairs_ = pair_storage_;
+    } else {
+        slots_ = other.slots_;
+        pairs_ = other.pairs_;
+    }
+    return *this;
+}
+
+void MergeIndex::build(std::vector<Pair> merges) {
+    pair_storage_ = std::move(merges);
+    slot_storage_.clear();
+    mask_ = 0;
+    
+    if (!pair_storage_.empty()) {
+        // Keep the load factor at or below 1/2 so probes rarely leave a cache line
+        const size_t capacity = std::bit_ceil(pair_storage_.size() * 2);
+        slot_storage_.assign(capacity, Slot{kEmptyKey, {0, 0}});
+        mask_ = capacity - 1;
+        
+        for (size_t rank = 0; rank < pair_storage_.size(); ++rank) {
+            const uint64_t key = pack_pair(pair_storage_[rank].first, pair_storage_[rank].second);
+            if (key == kEmptyKey) continue; // (-1, -1) can never occur in a word
+            const Entry entry = {static_cast<int32_t>(rank), static_cast<Token>(256 + rank)};
+            for (size_t i = hash_pair_key(key) & mask_;; i = (i + 1) & mask_) {
+                Slot& slot = slot_storage_[i];
+                if (slot.key == kEmptyKey || slot.key == key) {
+                    slot = {key, entry};
+                    break;
+                }
+            }
+        }
+    }
+    
+    slots_ = slot_storage_;
+    pairs_ = pair_storage_;
+}
+
+bool MergeIndex::attach(std::span<const Slot> slots, std::span<const Pair> pairs) {
+    if (!slots.empty() && !std::has_single_bit(slots.size())) return false;
+    if (slots.empty() && !pairs.empty()) return false;
+    
+    // find() stops at an empty slot, so one must exist; every entry must be
+    // the merge its key names, or lookups would hand out foreign tokens
+    bool has_empty = slots.empty();
+    for (const Slot& slot : slots) {
+        if (slot.key == kEmptyKey) {
+            has_empty = true;
+            continue;
+        }
+        const int32_t rank = slot.entry.rank;
+        if (rank < 0 || static_cast<size_t>(rank) >= pairs.size() ||
+            slot.entry.token != static_cast<Token>(256 + rank) ||
+            slot.key != pack_pair(pairs[rank].first, pairs[rank].second)) {
+            return false;
+        }
+    }
+    if (!has_empty) return false;
+    
+    slot_storage_.clear();
+    pair_storage_.clear();
+    slots_ = slots;
+    pairs_ = pairs;
+    mask_ = slots.empty() ? 0 : slots.size() - 1;
+    return true;
+}
+
+void MergeIndex::clear() noexcept {
+    slot_storage_.clear();
+    pair_storage_.clear();
+    slots_ = {};
+    pairs_ = {};
+    mask_ = 0;
+}
+
+const Pair& MergesView::at(Token token) const {
+    if (!contains(token)) {
+        throw std::out_of_range("tknzr::MergesView::at: token is not a merge");
+    }
+    return pairs_[token - 256];
+}
+
+} // namespace tknzr
@@ -0,0 +1,127 @@
+#include "metrics.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace tknzr {
+
+#if TKNZR_METRICS
+
+// ============================================================================
+// Per-thread shards
+// ============================================================================
+//
+// Each thread registers its shard on first use. A snapshot sums the live
+// shards plus the totals folded in by threads that have exited; a reset
+// only moves the baseline that snapshots subtract, so it never writes to
+// another thread's shard.
+
+namespace {
+
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry* registry = new Registry();  // Outlives thread_local shards at exit
+        return *registry;
+    }
+    
+    void attach(metrics::Shard* shard) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        live_.push_back(shard);
+    }
+    
+    void detach(metrics::Shard* shard) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        accumulate(*shard, retired_);
+        std::erase(live_, shard);
+    }
+    
+    MetricsSnapshot snapshot() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        MetricsSnapshot sum = total();
+        for (size_t c = 0; c < kCounterCount; ++c) sum.counters[c] -= baseline_.counters[c];
+        for (size_t s = 0; s < kStageCount; ++s) {
+            LatencyHistogram& stage = sum.stages[s];
+            const LatencyHistogram& base = baseline_.stages[s];
+            for (size_t b = 0; b < LatencyHistogram::kBuckets; ++b) stage.buckets[b] -= base.buckets[b];
+            stage.count -= base.count;
+            stage.total_ns -= base.total_ns;
+        }
+        return sum;
+    }
+    
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        baseline_ = total();
+    }
+
+private:
+    // Caller holds mutex_
+    MetricsSnapshot total() const {
+        MetricsSnapshot sum = retired_;
+        for (const metrics::Shard* shard : live_) accumulate(*shard, sum);
+        return sum;
+    }
+    
+    static void accumulate(const metrics::Shard& shard, MetricsSnapshot& sum) {
+        for (size_t c = 0; c < kCounterCount; ++c) {
+            sum.counters[c] += shard.counters[c].load(std::memory_order_relaxed);
+        }
+        for (size_t s = 0; s < kStageCount; ++s) {
+            LatencyHistogram& stage = sum.stages[s];
+            for (size_t b = 0; b < LatencyHistogram::kBuckets; ++b) {
+                const uint64_t n = shard.buckets[s][b].load(std::memory_order_relaxed);
+                stage.buckets[b] += n;
+                stage.count += n;
+            }
+            stage.total_ns += shard.total_ns[s].load(std::memory_order_relaxed);
+        }
+    }
+    
+    std::mutex mutex_;
+    std::vector<metrics::Shard*> live_;
+    MetricsSnapshot retired_;
+    MetricsSnapshot baseline_;
+};
+
+struct ShardOwner {
+    std::unique_ptr<metrics::Shard> shard = std::make_unique<metrics::Shard>();
+    
+    ShardOwner() { Registry::instance().attach(shard.get()); }
+    ~ShardOwner() { Registry::instance().detach(shard.get()); }
+};
+
+} // namespace
+
+metrics::Shard& metrics::local_shard() noexcept {
+    thread_local ShardOwner owner;
+    return *owner.shard;
+}
+
+bool metrics_enabled() noexcept {
+    return true;
+}
+
+MetricsSnapshot metrics_snapshot() {
+    return Registry::instance().snapshot();
+}
+
+void reset_metrics() {
+    Registry::instance().reset();
+}
+
+#else
+
+bool metrics_enabled() noexcept {
+    return false;
+}
+
+MetricsSnapshot metrics_snapshot() {
+    return {};
+}
+
+void reset_metrics() {}
+
+#endif // TKNZR_METRICS
+
+} // namespace tknzr
@@ -0,0 +1,101 @@
+#pragma once
+#include "tknzr/metrics.hpp"
+
+// Instrumentation hooks for the hot paths. With TKNZR_METRICS off every macro
+// expands to nothing, so release builds carry no counters or clock reads.
+
+#if TKNZR_METRICS
+
+#include <atomic>
+#include <chrono>
+
+namespace tknzr::metrics {
+
+    // One thread's counters. Only the owning thread writes, with a relaxed
+    // load and store instead of an atomic add, so recording never contends;
+    // the atomics only make concurrent snapshot reads well defined.
+    struct Shard {
+        std::array<std::atomic<uint64_t>, kCounterCount> counters{};
+        std::array<std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets>, kStageCount> buckets{};
+        std::array<std::atomic<uint64_t>, kStageCount> total_ns{};
+        std::array<uint32_t, kStageCount> ticks{};  // Owner only: per-stage sampling counters
+    };
+    
+    Shard& local_shard() noexcept;
+    
+    inline void bump(std::atomic<uint64_t>& value, uint64_t n) noexcept {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    
+    inline void add(Counter counter, uint64_t n) noexcept {
+        bump(local_shard().counters[static_cast<size_t>(counter)], n);
+    }
+    
+    inline uint64_t now_ns() noexcept {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    
+    inline void record(Stage stage, uint64_t ns) noexcept {
+        Shard& shard = local_shard();
+        bump(shard.buckets[static_cast<size_t>(stage)][LatencyHistogram::bucket_of(ns)], 1);
+        bump(shard.total_ns[static_cast<size_t>(stage)], ns);
+    }
+    
+    // Per-piece stages time one piece in kSampleEvery; two clock reads per
+    // piece would otherwise cost about as much as merging it
+    constexpr uint32_t kSampleEvery = 16;
+    
+    inline bool sample(Stage stage) noexcept {
+        return ++local_shard().ticks[static_cast<size_t>(stage)] % kSampleEvery == 0;
+    }
+    
+    // Records the lifetime of a scope into a stage histogram; sampled scopes
+    // only every kSampleEvery-th time
+    class ScopedTimer {
+    public:
+        ScopedTimer(Stage stage, bool sampled) noexcept
+            : stage_(stage), start_(!sampled || sample(stage) ? now_ns() : 0) {}
+        ~ScopedTimer() {
+            if (start_) record(stage_, now_ns() - start_);
+        }
+    
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+    
+    private:
+        Stage stage_;
+        uint64_t start_;  // 0 when this scope is not sampled
+    };
+    
+    // Times the pre-tokenizer's scan for each (sampled) piece: the gap
+    // between finishing one piece and being handed the next
+    class ScanTimer {
+    public:
+        ScanTimer() noexcept { next(); }
+    
+        void scanned() noexcept {
+            if (start_) record(Stage::Pretokenize, now_ns() - start_);
+        }
+        void next() noexcept { start_ = sample(Stage::Pretokenize) ? now_ns() : 0; }
+    
+    private:
+        uint64_t start_;
+    };
+}
+
+#define TKNZR_METRIC_ADD(counter, n) ::tknzr::metrics::add(::tknzr::Counter::counter, (n))
+#define TKNZR_METRIC_TIME_SCOPE(stage) \
+    ::tknzr::metrics::ScopedTimer tknzr_metric_timer_##stage(::tknzr::Stage::stage, false)
+#define TKNZR_METRIC_SAMPLE_SCOPE(stage) \
+    ::tknzr::metrics::ScopedTimer tknzr_metric_timer_##stage(::tknzr::Stage::stage, true)
+#define TKNZR_METRICS_ONLY(...) __VA_ARGS__
+
+#else
+
+#define TKNZR_METRIC_ADD(counter, n) ((void)0)
+#define TKNZR_METRIC_TIME_SCOPE(stage) ((void)0)
+#define TKNZR_METRIC_SAMPLE_SCOPE(stage) ((void)0)
+#define TKNZR_METRICS_ONLY(...)
+
+#endif
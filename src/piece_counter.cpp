@@ -0,0 +1,105 @@
+#include "piece_counter.hpp"
+#include "tknzr/merge_index.hpp"
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+namespace tknzr {
+
+namespace {
+
+// Rough per-entry overhead of the map node, string header and bucket
+constexpr size_t kEntryOverhead = 80;
+
+size_t shard_hash(std::string_view piece) noexcept {
+    // High bits of a 64-bit remix pick the shard, so the per-shard map still
+    // sees well spread low bits even where size_t is 32 bits
+    return static_cast<size_t>(hash_pair_key(std::hash<std::string_view>()(piece)) >> 32);
+}
+
+} // namespace
+
+PieceCounter::PieceCounter(SplitPattern pattern, size_t chunk_bytes, size_t shard_count)
+    : pretokenizer_(pattern),
+      chunk_bytes_(std::max<size_t>(chunk_bytes, 1)),
+      shard_count_(std::max<size_t>(shard_count, 1)) {
+    shards_ = std::make_unique<Shard[]>(shard_count_);
+}
+
+std::vector<std::string_view> PieceCounter::chunks(std::string_view text) const {
+    std::vector<std::string_view> result;
+    // Cuts only fall where a piece certainly begins under the pattern; with
+    // SplitPattern::None there is no such position and the text stays whole
+    while (text.size() > chunk_bytes_) {
+        const size_t cut = pretokenizer_.boundary_after(text, chunk_bytes_);
+        if (cut == text.size()) break;
+        result.push_back(text.substr(0, cut));
+        text.remove_prefix(cut);
+    }
+    if (!text.empty()) result.push_back(text);
+    return result;
+}
+
+void PieceCounter::count(std::span<const std::string_view> chunks, ThreadPool& pool) {
+    std::vector<size_t> order(chunks.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return chunks[a].size() > chunks[b].size(); });
+    
+    pool.parallel_for(order, [&](size_t i, size_t) { count_chunk(chunks[i]); });
+}
+
+void PieceCounter::count_chunk(std::string_view chunk) {
+    std::unordered_map<std::string_view, uint64_t> local;
+    pretokenizer_.for_each_piece(chunk, [&](std::string_view piece) { local[piece]++; });
+    
+    // Group by shard so each shard lock is taken once for this chunk
+    std::vector<std::vector<Entry>> by_shard(shard_count_);
+    for (const auto& entry : local) {
+        by_shard[shard_hash(entry.first) % shard_count_].push_back(entry);
+    }
+    for (size_t s = 0; s < shard_count_; ++s) {
+        if (by_shard[s].empty()) continue;
+        Shard& shard = shards_[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t added = 0;
+        for (const auto& [piece, count] : by_shard[s]) {
+            auto [it, inserted] = shard.counts.try_emplace(std::string(piece), 0);
+            it->second += count;
+            if (inserted) added += kEntryOverhead + piece.size();
+        }
+        memory_bytes_.fetch_add(added, std::memory_order_relaxed);
+    }
+}
+
+size_t PieceCounter::unique_pieces() const {
+    size_t total = 0;
+    for (size_t s = 0; s < shard_count_; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        total += shards_[s].counts.size();
+    }
+    return total;
+}
+
+std::vector<PieceCounter::Entry> PieceCounter::sorted() const {
+    std::vector<Entry> entries;
+    entries.reserve(unique_pieces());
+    for (size_t s = 0; s < shard_count_; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        for (const auto& [piece, count] : shards_[s].counts) {
+            entries.emplace_back(piece, count);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+void PieceCounter::clear() {
+    for (size_t s = 0; s < shard_count_; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        shards_[s].counts.clear();
+    }
+    memory_bytes_.store(0, std::memory_order_relaxed);
+}
+
+} // namespace tknzr
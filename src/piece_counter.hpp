@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tknzr/pretokenizer.hpp"
+#include "thread_pool.hpp"
+
+namespace tknzr {
+
+    /**
+     * Parallel counter of unique pre-tokenized pieces
+     *
+     * Texts are cut into chunks at boundaries the split patterns never cross,
+     * and each chunk is pre-tokenized and counted into a worker-local map
+     * keyed by views into the input. The local counts are then flushed into
+     * hash-sharded maps that own their keys, taking each shard lock once per
+     * chunk, so counts accumulate across count() calls.
+     */
+    class PieceCounter {
+    public:
+        using Entry = std::pair<std::string_view, uint64_t>;
+
+        /**
+         * @param pattern Split pattern used to pre-tokenize
+         * @param chunk_bytes Target chunk size for splitting long texts
+         * @param shard_count Number of independently locked maps
+         */
+        explicit PieceCounter(SplitPattern pattern, size_t chunk_bytes = size_t{1} << 20,
+                              size_t shard_count = 64);
+
+        /**
+         * Pre-tokenize and count chunks (from chunks()) on the given pool
+         */
+        void count(std::span<const std::string_view> chunks, ThreadPool& pool);
+
+        size_t unique_pieces() const;
+
+        /**
+         * Estimated heap usage of the counted pieces
+         */
+        size_t memory_bytes() const noexcept { return memory_bytes_.load(std::memory_order_relaxed); }
+
+        /**
+         * All counted pieces in byte order (views stay valid until clear())
+         */
+        std::vector<Entry> sorted() const;
+
+        void clear();
+
+        /**
+         * Split text into chunks of roughly chunk_bytes that pre-tokenize to
+         * the same pieces as the whole text
+         */
+        std::vector<std::string_view> chunks(std::string_view text) const;
+
+    private:
+        struct alignas(64) Shard {
+            std::mutex mutex;
+            std::unordered_map<std::string, uint64_t> counts;
+        };
+
+        void count_chunk(std::string_view chunk);
+
+        PreTokenizer pretokenizer_;
+        size_t chunk_bytes_;
+        size_t shard_count_;
+        std::unique_ptr<Shard[]> shards_;
+        std::atomic<size_t> memory_bytes_{0};
+    };
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tknzr {
+
+    /**
+     * Weighted unique pieces in byte order, stored back to back
+     *
+     * This is the whole input of BPE training once counting is done, so it
+     * is what a training checkpoint saves. Pieces of a single byte have no
+     * pairs and are not stored.
+     */
+    struct PieceTable {
+        std::string arena;
+        std::vector<uint32_t> lengths;
+        std::vector<uint64_t> counts;
+
+        void add(std::string_view piece, uint64_t count) {
+            if (piece.size() < 2) return;
+            arena.append(piece);
+            lengths.push_back(static_cast<uint32_t>(piece.size()));
+            counts.push_back(count);
+        }
+
+        size_t size() const noexcept { return counts.size(); }
+
+        /**
+         * Call fn(std::string_view piece, uint64_t count) for each piece
+         */
+        template <typename Fn>
+        void for_each(Fn&& fn) const {
+            size_t offset = 0;
+            for (size_t i = 0; i < counts.size(); ++i) {
+                fn(std::string_view(arena).substr(offset, lengths[i]), counts[i]);
+                offset += lengths[i];
+            }
+        }
+    };
+}
@@ -0,0 +1,183 @@
+#include "tknzr/pretokenizer.hpp"
+#include "ascii_scan.hpp"
+#include "unicode.hpp"
+#include <algorithm>
+
+namespace tknzr {
+
+namespace {
+
+using unicode::CharClass;
+using unicode::decode;
+
+bool is_newline(uint32_t cp) noexcept {
+    return cp == '\r' || cp == '\n';
+}
+
+// Length of 's|'t|'re|'ve|'m|'ll|'d at text[0] == '\'', or 0.
+// Case-insensitive matching also accepts U+017F LATIN SMALL LETTER LONG S,
+// which simple case folding maps to 's'.
+size_t contraction_length(std::string_view text, bool ignore_case) noexcept {
+    if (text.size() < 2) return 0;
+    const auto lower = [&](size_t i) -> char {
+        const char c = text[i];
+        return ignore_case && c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    };
+    
+    switch (lower(1)) {
+        case 's': case 't': case 'm': case 'd':
+            return 2;
+        case 'r': case 'v':
+            return text.size() >= 3 && lower(2) == 'e' ? 3 : 0;
+        case 'l':
+            return text.size() >= 3 && lower(2) == 'l' ? 3 : 0;
+        default:
+            break;
+    }
+    if (ignore_case && text.size() >= 3 &&
+        static_cast<unsigned char>(text[1]) == 0xC5 && static_cast<unsigned char>(text[2]) == 0xBF) {
+        return 3;
+    }
+    return 0;
+}
+
+// End of the run of characters of class cls starting at pos. ASCII stretches
+// go through the vectorized scan; only multi-byte characters are decoded.
+size_t run_end(std::string_view text, size_t pos, CharClass cls) noexcept {
+    while (pos < text.size()) {
+        pos = unicode::ascii_run_end(text, pos, cls);
+        if (pos == text.size() || static_cast<unsigned char>(text[pos]) < 0x80) break;
+        const auto c = decode(text, pos);
+        if (c.cls != cls) break;
+        pos += c.length;
+    }
+    return pos;
+}
+
+// Length of the piece for a whitespace run at text[0] under
+// \s+(?!\S)|\s+, optionally preceded by \s*[\r\n]+ (cl100k).
+size_t whitespace_length(std::string_view text, bool split_newlines) noexcept {
+    size_t pos = 0;
+    size_t last_start = 0;
+    size_t newline_end = 0;
+    while (pos < text.size()) {
+        // ASCII whitespace is one byte per character, so a skipped stretch
+        // only needs its last byte and its last newline recorded
+        const size_t ascii_end = unicode::ascii_run_end(text, pos, CharClass::Space);
+        if (ascii_end > pos) {
+            last_start = ascii_end - 1;
+            for (size_t i = ascii_end; i > pos; --i) {
+                if (is_newline(static_cast<unsigned char>(text[i - 1]))) {
+                    newline_end = i;
+                    break;
+                }
+            }
+            pos = ascii_end;
+        }
+        if (pos == text.size() || static_cast<unsigned char>(text[pos]) < 0x80) break;
+        const auto c = decode(text, pos);
+        if (c.cls != CharClass::Space) break;
+        last_start = pos;
+        pos += c.length;
+        if (is_newline(c.codepoint)) newline_end = pos;
+    }
+    
+    // \s*[\r\n]+ backtracks to just after the last newline in the run
+    if (split_newlines && newline_end != 0) return newline_end;
+    // \s+(?!\S) leaves the last whitespace character for the next piece
+    if (pos < text.size() && last_start != 0) return last_start;
+    return pos;
+}
+
+size_t next_piece_gpt2(std::string_view text) noexcept {
+    const auto first = decode(text, 0);
+    if (first.codepoint == '\'') {
+        if (size_t length = contraction_length(text, false)) return length;
+    }
+    
+    const size_t start = first.codepoint == ' ' ? 1 : 0;
+    if (start < text.size()) {
+        const auto c = decode(text, start);
+        if (c.cls != CharClass::Space) {
+            return run_end(text, start, c.cls);
+        }
+    }
+    return whitespace_length(text, false);
+}
+
+size_t next_piece_cl100k(std::string_view text) noexcept {
+    const auto first = decode(text, 0);
+    if (first.codepoint == '\'') {
+        if (size_t length = contraction_length(text, true)) return length;
+    }
+    
+    // [^\r\n\p{L}\p{N}]?\p{L}+
+    if (first.cls == CharClass::Letter) {
+        return run_end(text, 0, CharClass::Letter);
+    }
+    if (first.cls != CharClass::Number && !is_newline(first.codepoint) && first.length < text.size()) {
+        if (decode(text, first.length).cls == CharClass::Letter) {
+            return run_end(text, first.length, CharClass::Letter);
+        }
+    }
+    
+    // \p{N}{1,3}
+    if (first.cls == CharClass::Number) {
+        size_t pos = first.length;
+        for (int i = 1; i < 3 && pos < text.size(); ++i) {
+            const auto c = decode(text, pos);
+            if (c.cls != CharClass::Number) break;
+            pos += c.length;
+        }
+        return pos;
+    }
+    
+    //  ?[^\s\p{L}\p{N}]+[\r\n]*
+    const size_t start = first.codepoint == ' ' ? 1 : 0;
+    size_t pos = run_end(text, start, CharClass::Other);
+    if (pos > start) {
+        while (pos < text.size() && is_newline(static_cast<unsigned char>(text[pos]))) ++pos;
+        return pos;
+    }
+    
+    // \s*[\r\n]+|\s+(?!\S)|\s+
+    return whitespace_length(text, true);
+}
+
+} // namespace
+
+size_t PreTokenizer::next_piece(std::string_view text) const noexcept {
+    if (text.empty()) return 0;
+    switch (pattern_) {
+        case SplitPattern::GPT2:
+            return next_piece_gpt2(text);
+        case SplitPattern::CL100K:
+            return next_piece_cl100k(text);
+        case SplitPattern::None:
+            break;
+    }
+    return text.size();
+}
+
+size_t PreTokenizer::boundary_after(std::string_view text, size_t pos) const noexcept {
+    if (pattern_ == SplitPattern::None) return text.size();
+    // Letter runs end at the first non-letter and nothing else spans a
+    // letter, so the piece holding text[pos - 1] ends exactly at pos
+    for (pos = std::max<size_t>(pos, 1); pos < text.size(); ++pos) {
+        const unsigned char before = static_cast<unsigned char>(text[pos - 1]);
+        const unsigned char at = static_cast<unsigned char>(text[pos]);
+        if (before < 0x80 && at < 0x80 && unicode::classify_ascii(before) == CharClass::Letter &&
+            unicode::classify_ascii(at) != CharClass::Letter) {
+            return pos;
+        }
+    }
+    return text.size();
+}
+
+std::vector<std::string_view> PreTokenizer::split(std::string_view text) const {
+    std::vector<std::string_view> pieces;
+    for_each_piece(text, [&](std::string_view piece) { pieces.push_back(piece); });
+    return pieces;
+}
+
+} // namespace tknzr
@@ -0,0 +1,107 @@
+#include "tknzr/special_tokens.hpp"
+#include <deque>
+
+namespace tknzr {
+
+SpecialTokens::SpecialTokens() {
+    compile();
+}
+
+bool SpecialTokens::add(std::string_view text, Token token) {
+    if (text.empty()) return false;
+    for (const auto& [existing, existing_token] : entries_) {
+        if (existing == text || existing_token == token) return false;
+    }
+    entries_.emplace_back(text, token);
+    compile();
+    return true;
+}
+
+void SpecialTokens::compile() {
+    // Trie of all entries; -1 marks a missing edge until the BFS fills it in
+    states_.assign(1, State{});
+    states_[0].next.fill(-1);
+    first_bytes_.reset();
+    for (size_t e = 0; e < entries_.size(); ++e) {
+        int32_t state = 0;
+        for (unsigned char c : entries_[e].first) {
+            if (states_[state].next[c] < 0) {
+                State child;
+                child.next.fill(-1);
+                child.depth = states_[state].depth + 1;
+                states_[state].next[c] = static_cast<int32_t>(states_.size());
+                states_.push_back(child);
+            }
+            state = states_[state].next[c];
+        }
+        states_[state].output = static_cast<int32_t>(e);
+        first_bytes_.set(static_cast<unsigned char>(entries_[e].first[0]));
+    }
+    
+    // Breadth-first, each state's missing edges copy its failure state's, which
+    // turns the trie into a full DFA
+    std::vector<int32_t> fail(states_.size(), 0);
+    std::deque<int32_t> queue;
+    for (int c = 0; c < 256; ++c) {
+        int32_t& child = states_[0].next[c];
+        if (child < 0) {
+            child = 0;
+        } else {
+            queue.push_back(child);
+        }
+    }
+    while (!queue.empty()) {
+        const int32_t state = queue.front();
+        queue.pop_front();
+        const int32_t link = fail[state];
+        states_[state].dictionary = states_[link].output >= 0 ? link : states_[link].dictionary;
+        for (int c = 0; c < 256; ++c) {
+            const int32_t child = states_[state].next[c];
+            if (child < 0) {
+                states_[state].next[c] = states_[link].next[c];
+            } else {
+                fail[child] = state == 0 ? 0 : states_[link].next[c];
+                queue.push_back(child);
+            }
+        }
+    }
+}
+
+std::optional<SpecialTokens::Match> SpecialTokens::find(std::string_view text, size_t from) const noexcept {
+    if (entries_.empty()) return std::nullopt;
+    
+    std::optional<Match> best;
+    int32_t state = 0;
+    for (size_t i = from; i < text.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if (state == 0 && !first_bytes_.test(c)) {
+            if (best) break;
+            continue;
+        }
+        state = states_[state].next[c];
+    
+        // Once no partial match starts at or before the best match, nothing
+        // further right can beat it
+        const size_t live_start = i + 1 - static_cast<size_t>(states_[state].depth);
+        if (best && live_start > best->begin) break;
+    
+        for (int32_t s = states_[state].output >= 0 ? state : states_[state].dictionary; s >= 0;
+             s = states_[s].dictionary) {
+            const size_t length = static_cast<size_t>(states_[s].depth);
+            const size_t begin = i + 1 - length;
+            if (!best || begin < best->begin || (begin == best->begin && length > best->length)) {
+                best = Match{begin, length, entries_[states_[s].output].second};
+            }
+        }
+    }
+    return best;
+}
+
+std::optional<Token> SpecialTokens::token_of(std::string_view text) const noexcept {
+    for (const auto& [existing, token] : entries_) {
+        if (existing == text) return token;
+    }
+    return std::nullopt;
+}
+
+} // namespace tknzr
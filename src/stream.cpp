@@ -0,0 +1,163 @@
+#include "tknzr/stream.hpp"
+#include "unicode.hpp"
+#include <algorithm>
+
+namespace tknzr {
+
+namespace {
+
+constexpr std::string_view kReplacement = "\xEF\xBF\xBD";  // U+FFFD
+
+// Append the valid characters of text to out, replacing each invalid byte
+// with U+FFFD, and stop before a sequence cut off at the end
+// @return Bytes consumed; the rest is an unfinished character
+size_t append_complete(std::string_view text, std::string& out) {
+    const size_t end = text.size() - unicode::incomplete_suffix(text);
+    size_t run = 0;  // Start of the pending run of valid bytes
+    size_t pos = 0;
+    while (pos < end) {
+        if (static_cast<unsigned char>(text[pos]) < 0x80) {
+            pos++;
+            continue;
+        }
+        const unicode::DecodedChar c = unicode::decode(text, pos);
+        if (c.length > 1) {
+            pos += c.length;
+            continue;
+        }
+        out.append(text.substr(run, pos - run));
+        out.append(kReplacement);
+        run = ++pos;
+    }
+    out.append(text.substr(run, end - run));
+    return end;
+}
+
+// Character starting at pos, with the ASCII fast path
+unicode::DecodedChar char_at(std::string_view text, size_t pos) noexcept {
+    const unsigned char c = static_cast<unsigned char>(text[pos]);
+    return c < 0x80 ? unicode::DecodedChar{c, 1, unicode::classify_ascii(c)} : unicode::decode(text, pos);
+}
+
+// Class of the last character of a non-empty text that ends on a character
+// boundary; a stray continuation byte counts as Other
+unicode::CharClass last_char_class(std::string_view text) noexcept {
+    size_t start = text.size() - 1;
+    while (start > 0 && text.size() - start < 4 && (static_cast<unsigned char>(text[start]) & 0xC0) == 0x80) {
+        start--;
+    }
+    const unicode::DecodedChar c = char_at(text, start);
+    return start + c.length == text.size() ? c.cls : unicode::CharClass::Other;
+}
+
+// Contractions such as "'ll" decide a piece from up to this many bytes
+constexpr size_t kContractionBytes = 3;
+
+} // namespace
+
+StreamEncoder::StreamEncoder(const Tokenizer& tokenizer)
+    : tokenizer_(tokenizer),
+      pretokenizer_(tokenizer.split_pattern()) {}
+
+void StreamEncoder::emit(std::string_view piece, TokenList& out) {
+    const std::span<const Token> tokens = tokenizer_.encode_piece(piece, scratch_);
+    out.insert(out.end(), tokens.begin(), tokens.end());
+}
+
+void StreamEncoder::write(std::string_view chunk, TokenList& out) {
+    pending_.append(chunk);
+    if (pretokenizer_.pattern() == SplitPattern::None) return;  // One piece until finish()
+    
+    // Classify only the characters new since the last call. A cut-off UTF-8
+    // sequence at the end is held back unscanned.
+    std::string_view text(pending_);
+    text.remove_suffix(unicode::incomplete_suffix(text));
+    bool only_space = true;
+    bool extends_run = true;
+    for (size_t pos = scanned_; pos < text.size();) {
+        const unicode::DecodedChar c = char_at(text, pos);
+        pos += c.length;
+        if (c.cls == unicode::CharClass::Space) {
+            extends_run = false;
+        } else {
+            only_space = false;
+            content_end_ = pos;
+            if (static_cast<uint8_t>(c.cls) != run_class_) extends_run = false;
+        }
+    }
+    scanned_ = text.size();
+    
+    // The held-back piece cannot have ended if more of its run arrived, or
+    // more whitespace after a piece that already reaches into whitespace
+    if ((held_ == Held::Run && extends_run) || (held_ == Held::Whitespace && only_space)) return;
+    
+    // Whitespace patterns such as \s*[\r\n]+ and \s+(?!\S) can reach through a
+    // trailing whitespace run to whatever comes next, so a piece is final
+    // only if it ends before that run and is not the last piece. It must also
+    // start far enough from the end for a contraction to be decided.
+    size_t consumed = 0;
+    held_ = Held::Nothing;
+    while (text.size() - consumed >= kContractionBytes) {
+        const size_t end = consumed + pretokenizer_.next_piece(text.substr(consumed));
+        if (end > content_end_) {
+            held_ = Held::Whitespace;
+            break;
+        }
+        if (end == text.size()) {
+            // Longer than any contraction, so only a different character
+            // can end it; CL100K numbers also stop after three digits
+            const unicode::CharClass cls = last_char_class(text);
+            if (end - consumed > kContractionBytes &&
+                (cls != unicode::CharClass::Number || pretokenizer_.pattern() == SplitPattern::GPT2)) {
+                held_ = Held::Run;
+                run_class_ = static_cast<uint8_t>(cls);
+            }
+            break;
+        }
+        emit(text.substr(consumed, end - consumed), out);
+        consumed = end;
+    }
+    pending_.erase(0, consumed);
+    scanned_ -= consumed;
+    content_end_ -= consumed;
+}
+
+void StreamEncoder::finish(TokenList& out) {
+    pretokenizer_.for_each_piece(pending_, [&](std::string_view piece) { emit(piece, out); });
+    reset();
+}
+
+void StreamDecoder::write(Token token, std::string& out) {
+    std::string_view bytes = tokenizer_.token_bytes_[token];
+    
+    // Finish the carried character a byte at a time; the carry never holds
+    // more than 3 bytes, so this touches at most 3 bytes of the token
+    while (carry_size_ > 0 && !bytes.empty()) {
+        carry_[carry_size_++] = bytes.front();
+        bytes.remove_prefix(1);
+        const size_t consumed = append_complete(std::string_view(carry_, carry_size_), out);
+        std::copy(carry_ + consumed, carry_ + carry_size_, carry_);
+        carry_size_ = static_cast<uint8_t>(carry_size_ - consumed);
+    }
+    if (bytes.empty()) return;
+    
+    const size_t consumed = append_complete(bytes, out);
+    bytes.remove_prefix(consumed);
+    std::copy(bytes.begin(), bytes.end(), carry_);
+    carry_size_ = static_cast<uint8_t>(bytes.size());
+}
+
+void StreamDecoder::write(std::span<const Token> tokens, std::string& out) {
+    for (Token token : tokens) {
+        write(token, out);
+    }
+}
+
+void StreamDecoder::finish(std::string& out) {
+    for (uint8_t i = 0; i < carry_size_; ++i) {
+        out.append(kReplacement);
+    }
+    carry_size_ = 0;
+}
+
+} // namespace tknzr
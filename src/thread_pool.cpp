@@ -0,0 +1,140 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace tknzr {
+
+namespace {
+
+// Pool whose tasks the current thread is running, if any
+thread_local const ThreadPool* running_pool = nullptr;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+    const size_t count = std::max<size_t>(threads, 1);
+    queue_storage_ = std::make_unique<Queue[]>(count);
+    for (size_t i = 0; i < count; ++i) {
+        queues_.push_back(&queue_storage_[i]);
+    }
+    threads_.reserve(count - 1);
+    for (size_t worker = 1; worker < count; ++worker) {
+        threads_.emplace_back([this, worker] { worker_main(worker); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::parallel_for(const std::vector<size_t>& order, const Task& task) {
+    if (order.empty()) return;
+    // A task that calls back into its own pool would wait on job_mutex_
+    // forever, so nested calls run on the calling worker instead
+    if (size() == 1 || order.size() == 1 || running_pool == this) {
+        for (size_t index : order) task(index, 0);
+        return;
+    }
+    
+    std::lock_guard<std::mutex> job_lock(job_mutex_);
+    for (size_t i = 0; i < order.size(); ++i) {
+        Queue& queue = *queues_[i % size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.items.push_back(order[i]);
+    }
+    remaining_.store(order.size(), std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        task_ = &task;
+        error_ = nullptr;
+        ++generation_;
+    }
+    wake_.notify_all();
+    
+    const ThreadPool* outer = running_pool;
+    running_pool = this;
+    run_tasks(0);
+    running_pool = outer;
+    
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    done_.wait(lock, [this] {
+        return remaining_.load(std::memory_order_acquire) == 0 && active_ == 0;
+    });
+    task_ = nullptr;
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::worker_main(size_t worker) {
+    running_pool = this;
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex_);
+            wake_.wait(lock, [&] { return stopping_ || (generation_ != seen && task_); });
+            if (stopping_) return;
+            seen = generation_;
+            ++active_;
+        }
+        run_tasks(worker);
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            --active_;
+        }
+        done_.notify_all();
+    }
+}
+
+void ThreadPool::run_tasks(size_t worker) {
+    size_t index;
+    while (next_task(worker, index)) {
+        try {
+            (*task_)(index, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            done_.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::next_task(size_t worker, size_t& index) {
+    {
+        Queue& own = *queues_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            index = own.items.front();
+            own.items.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < size(); ++i) {
+        Queue& victim = *queues_[(worker + i) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            index = victim.items.back();
+            victim.items.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace tknzr
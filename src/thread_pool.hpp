@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tknzr {
+
+    /**
+     * Reusable fork-join pool with per-worker work-stealing queues
+     *
+     * parallel_for() deals task indices round-robin onto one deque per
+     * worker. A worker takes tasks from the front of its own deque and, once
+     * empty, steals from the back of the others, so a few long tasks never
+     * leave the remaining workers idle. The calling thread acts as worker 0.
+     */
+    class ThreadPool {
+    public:
+        using Task = std::function<void(size_t index, size_t worker)>;
+
+        /**
+         * @param threads Total workers including the caller (at least 1)
+         */
+        explicit ThreadPool(size_t threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        size_t size() const noexcept { return queues_.size(); }
+
+        /**
+         * Run task(i, worker) for every i in order[], blocking until all finish.
+         * Indices are dealt out in the given order, so callers can put the
+         * most expensive tasks first. Concurrent calls are serialized; a
+         * call made from inside one of this pool's tasks runs inline on the
+         * calling worker (with worker index 0) instead of deadlocking.
+         * The first exception thrown by a task is rethrown here.
+         */
+        void parallel_for(const std::vector<size_t>& order, const Task& task);
+
+        /**
+         * Process-wide pool sized to the hardware concurrency
+         */
+        static ThreadPool& shared();
+
+    private:
+        struct alignas(64) Queue {
+            std::mutex mutex;
+            std::deque<size_t> items;
+        };
+
+        void worker_main(size_t worker);
+        void run_tasks(size_t worker);
+        bool next_task(size_t worker, size_t& index);
+
+        std::unique_ptr<Queue[]> queue_storage_;
+        std::vector<Queue*> queues_;
+        std::vector<std::thread> threads_;
+
+        std::mutex job_mutex_;  // Serializes parallel_for callers
+        std::mutex state_mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        const Task* task_ = nullptr;
+        uint64_t generation_ = 0;
+        size_t active_ = 0;
+        bool stopping_ = false;
+        std::atomic<size_t> remaining_{0};
+        std::exception_ptr error_;
+    };
+}
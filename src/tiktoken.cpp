@@ -0,0 +1,220 @@
+#include "tknzr/tknzr.hpp"
+#include "base64.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace tknzr {
+
+// ============================================================================
+// tiktoken vocabulary format
+// ============================================================================
+//
+// One token per line, "<base64 token bytes> <rank>". Ranks 0-255 must be the
+// 256 single bytes in some order and ranks from 256 on the multi-byte
+// tokens, with no gaps; token ids are the ranks. The file lists no merges,
+// so each token's pair is recovered from its bytes (see recover_pair()).
+
+namespace {
+
+constexpr size_t kBlockTokens = 4096;  // Tokens recovered per pool task
+
+struct TokenSpan {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Pair -> token table that grows as merges are recovered
+class PairTable {
+public:
+    explicit PairTable(size_t merges)
+        : slots_(std::bit_ceil(merges * 2 + 2), Slot{MergeIndex::kEmptyKey, 0}), mask_(slots_.size() - 1) {}
+    
+    void insert(Token first, Token second, Token token) noexcept {
+        if (first < 256 && second < 256) {
+            byte_pairs_[(first << 8) | second] = token;
+            return;
+        }
+        const uint64_t key = pack_pair(first, second);
+        size_t i = hash_pair_key(key) & mask_;
+        while (slots_[i].key != MergeIndex::kEmptyKey) i = (i + 1) & mask_;
+        slots_[i] = {key, token};
+    }
+    
+    // Merged token, or -1; a lower token is a lower rank
+    Token find(Token first, Token second) const noexcept {
+        if (first < 256 && second < 256) return byte_pairs_[(first << 8) | second];
+        const uint64_t key = pack_pair(first, second);
+        for (size_t i = hash_pair_key(key) & mask_;; i = (i + 1) & mask_) {
+            if (slots_[i].key == key) return slots_[i].token;
+            if (slots_[i].key == MergeIndex::kEmptyKey) return -1;
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t key;
+        Token token;
+    };
+    
+    std::vector<Token> byte_pairs_ = std::vector<Token>(256 * 256, -1);  // Pairs of byte tokens, directly indexed
+    std::vector<Slot> slots_;
+    size_t mask_;
+};
+
+// Recover the pair a token was merged from: BPE over its bytes with the
+// merges of lower rank, lowest rank first and leftmost on ties as tiktoken
+// does, must end in exactly two parts. merged[i] caches the token of
+// (parts[i], parts[i + 1]) so each merge looks up only its two new pairs.
+bool recover_pair(std::string_view bytes, Token rank, const std::array<Token, 256>& byte_tokens,
+                  const PairTable& table, std::vector<Token>& parts, std::vector<Token>& merged) {
+    const auto find = [&](Token first, Token second) {
+        const Token token = table.find(first, second);
+        return token < rank ? token : -1;
+    };
+    parts.clear();
+    for (unsigned char c : bytes) parts.push_back(byte_tokens[c]);
+    merged.resize(parts.size() - 1);
+    for (size_t i = 0; i + 1 < parts.size(); ++i) merged[i] = find(parts[i], parts[i + 1]);
+    
+    while (parts.size() > 2) {
+        size_t best = 0;
+        for (size_t i = 1; i < merged.size(); ++i) {
+            if (merged[i] >= 0 && (merged[best] < 0 || merged[i] < merged[best])) best = i;
+        }
+        if (merged[best] < 0) break;
+        parts[best] = merged[best];
+        parts.erase(parts.begin() + static_cast<std::ptrdiff_t>(best) + 1);
+        merged.erase(merged.begin() + static_cast<std::ptrdiff_t>(best));
+        if (best > 0) merged[best - 1] = find(parts[best - 1], parts[best]);
+        if (best < merged.size()) merged[best] = find(parts[best], parts[best + 1]);
+    }
+    return parts.size() == 2 && merged[0] < 0;
+}
+
+// Split one line into its base64 field and rank
+bool parse_line(std::string_view line, std::string_view& base64, uint64_t& rank) noexcept {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    const size_t space = line.find(' ');
+    if (space == 0 || space == std::string_view::npos) return false;
+    base64 = line.substr(0, space);
+    const char* first = line.data() + space + 1;
+    const char* last = line.data() + line.size();
+    const auto [end, error] = std::from_chars(first, last, rank);
+    return error == std::errc() && end == last && first != last;
+}
+
+} // namespace
+
+bool Tokenizer::is_tiktoken(std::string_view data) {
+    std::string_view base64;
+    uint64_t rank;
+    const std::string_view line = data.substr(0, data.find('\n'));
+    if (!parse_line(line, base64, rank)) return false;
+    for (char c : base64) {
+        if (c != '=' && kBase64Table[static_cast<unsigned char>(c)] == kBase64Invalid) return false;
+    }
+    return true;
+}
+
+bool Tokenizer::load_tiktoken(std::string_view contents) {
+    // Decode every token into one arena, indexed by rank
+    std::string arena;
+    arena.reserve(contents.size());
+    std::vector<TokenSpan> by_rank;
+    by_rank.reserve(contents.size() / 8);
+    size_t count = 0;
+    constexpr TokenSpan kMissing = {0, std::numeric_limits<uint32_t>::max()};
+    
+    for (size_t pos = 0; pos < contents.size();) {
+        size_t end = contents.find('\n', pos);
+        if (end == std::string_view::npos) end = contents.size();
+        const std::string_view line = contents.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.empty() || line == "\r") continue;
+    
+        std::string_view base64;
+        uint64_t rank;
+        if (!parse_line(line, base64, rank) || rank >= contents.size()) return false;  // Ranks are dense
+    
+        const size_t offset = arena.size();
+        if (!base64_decode_append(base64, arena) || arena.size() == offset) return false;
+        if (rank >= by_rank.size()) by_rank.resize(rank + 1, kMissing);
+        if (by_rank[rank].length != kMissing.length) return false;
+        by_rank[rank] = {static_cast<uint32_t>(offset), static_cast<uint32_t>(arena.size() - offset)};
+        ++count;
+    }
+    if (count != by_rank.size() || count < 256) return false;
+    const auto bytes_of = [&](size_t rank) {
+        return std::string_view(arena).substr(by_rank[rank].offset, by_rank[rank].length);
+    };
+    
+    std::array<uint8_t, 256> base_bytes;
+    std::array<Token, 256> byte_tokens;
+    std::bitset<256> seen;
+    for (size_t rank = 0; rank < 256; ++rank) {
+        const std::string_view bytes = bytes_of(rank);
+        if (bytes.size() != 1 || seen.test(static_cast<unsigned char>(bytes[0]))) return false;
+        seen.set(static_cast<unsigned char>(bytes[0]));
+        base_bytes[rank] = static_cast<uint8_t>(bytes[0]);
+        byte_tokens[base_bytes[rank]] = static_cast<Token>(rank);
+    }
+    
+    // A token's parts are always shorter than it, so all tokens of one length
+    // are recovered in parallel against the pairs of the shorter ones, then
+    // their pairs are added for the next length
+    std::vector<size_t> level_start;  // Counting sort of the ranks by length
+    for (size_t rank = 256; rank < count; ++rank) {
+        if (by_rank[rank].length + 1 >= level_start.size()) level_start.resize(by_rank[rank].length + 2, 0);
+        ++level_start[by_rank[rank].length + 1];
+    }
+    std::partial_sum(level_start.begin(), level_start.end(), level_start.begin());
+    std::vector<size_t> order(count - 256);
+    for (size_t rank = 256; rank < count; ++rank) order[level_start[by_rank[rank].length]++] = rank;
+    
+    std::vector<Pair> merges(count - 256);
+    PairTable table(count - 256);
+    ThreadPool& pool = thread_pool();
+    std::atomic<bool> malformed{false};
+    for (size_t level = 0; level < order.size();) {
+        const uint32_t length = by_rank[order[level]].length;
+        size_t level_end = level;
+        while (level_end < order.size() && by_rank[order[level_end]].length == length) ++level_end;
+    
+        std::vector<size_t> blocks((level_end - level + kBlockTokens - 1) / kBlockTokens);
+        std::iota(blocks.begin(), blocks.end(), size_t{0});
+        pool.parallel_for(blocks, [&](size_t block, size_t) {
+            std::vector<Token> parts;
+            std::vector<Token> merged;
+            const size_t end = std::min(level + (block + 1) * kBlockTokens, level_end);
+            for (size_t i = level + block * kBlockTokens; i < end; ++i) {
+                const size_t rank = order[i];
+                if (!recover_pair(bytes_of(rank), static_cast<Token>(rank), byte_tokens, table, parts, merged)) {
+                    malformed = true;
+                    return;
+                }
+                merges[rank - 256] = {parts[0], parts[1]};
+            }
+        });
+        if (malformed) return false;
+    
+        for (size_t i = level; i < level_end; ++i) {
+            const Pair& pair = merges[order[i] - 256];
+            if (table.find(pair.first, pair.second) >= 0) return false;  // Two tokens with the same bytes
+            table.insert(pair.first, pair.second, static_cast<Token>(order[i]));
+        }
+        level = level_end;
+    }
+    
+    if (!freeze_vocabulary(std::move(merges), base_bytes)) return false;
+    vocab_size_ = static_cast<int>(count);
+    return true;
+}
+
+} // namespace tknzr
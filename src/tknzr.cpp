@@ -1,4 +1,10 @@
 #include "tknzr/tknzr.hpp"
+#include "tknzr/trainer.hpp"
+#include "base64.hpp"
+#include "bpe_trainer.hpp"
+#include "metrics.hpp"
+#include "thread_pool.hpp"
+#include "unicode.hpp"
 #include <iostream>
 #include <array>
 #include <fstream>
@@ -6,62 +12,25 @@
 #include <algorithm>
 #include <cctype>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
 
 namespace tknzr {
 
-// Base64 lookup table
-const std::string base64_lt =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-    "abcdefghijklmnopqrstuvwxyz"
-    "0123456789+/";
-
-bool is_base64(unsigned char c) {
-    return (isalnum(c) || (c == '+') || (c == '/'));
-}
-
+// Decode the longest valid base64 prefix (up to the first '=' or foreign
+// character), ignoring a dangling final character
 std::string base64_decode(std::string_view encoded_string) {
-    int str_len = encoded_string.size();
-    int i = 0;
-    int j = 0;
-    int in_ = 0;
-    std::array<unsigned char, 4> char_array_4;
-    std::array<unsigned char, 3> char_array_3;
-    std::string ret;
-    
-    while(str_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-        char_array_4[i++] = encoded_string[in_];
-        in_++;
-        if (i == 4) {
-            for (i = 0; i < 4; i++) {
-                char_array_4[i] = base64_lt.find(char_array_4[i]);
-            }
-            
-            // mapping 4 6-bit values to 3 bytes
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-            
-            for (i = 0; i < 3; i++)
-                ret += char_array_3[i];
-            i = 0;
-        }
-    }
-    
-    if (i) {
-        for (j = i; j < 4; j++)
-            char_array_4[j] = 0;
-        
-        for (j = 0; j < 4; j++)
-            char_array_4[j] = base64_lt.find(char_array_4[j]);
-
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-        
-        for (j = 0; j < i - 1; j++)
-            ret += char_array_3[j];
+    size_t length = 0;
+    while (length < encoded_string.size() &&
+           kBase64Table[static_cast<unsigned char>(encoded_string[length])] != kBase64Invalid) {
+        ++length;
     }
+    if (length % 4 == 1) --length;
     
+    std::string ret;
+    base64_decode_append(encoded_string.substr(0, length), ret);
     return ret;
 }
 
@@ -72,6 +41,8 @@ std::string base64_decode(std::string_view encoded_string) {
 Tokenizer::Tokenizer(int vocab_size) : vocab_size_(vocab_size) {
     // Initialize with base 256 tokens (one for each byte)
     // Default is 100256 for GPT-4/cl100k_base compatibility
+    std::iota(byte_tokens_.begin(), byte_tokens_.end(), Token{0});
+    token_bytes_.build(merges_);
 }
 
 std::vector<int> Tokenizer::bytes_to_unicode() const {
@@ -84,26 +55,6 @@ std::vector<int> Tokenizer::bytes_to_unicode() const {
     return bs;
 }
 
-std::vector<int> Tokenizer::text_to_bytes(const std::string& text) const {
-    std::vector<int> bytes;
-    bytes.reserve(text.size());
-    for (unsigned char c : text) {
-        bytes.push_back(static_cast<int>(c));
-    }
-    return bytes;
-}
-
-std::string Tokenizer::bytes_to_text(const std::vector<int>& bytes) const {
-    std::string text;
-    text.reserve(bytes.size());
-    for (int b : bytes) {
-        if (b >= 0 && b < 256) {
-            text += static_cast<char>(b);
-        }
-    }
-    return text;
-}
-
 std::vector<Pair> Tokenizer::get_word_pairs(const std::vector<int>& word) const {
     std::vector<Pair> pairs;
     if (word.size() < 2) return pairs;
@@ -115,160 +66,555 @@ std::vector<Pair> Tokenizer::get_word_pairs(const std::vector<int>& word) const
     return pairs;
 }
 
-Pair Tokenizer::get_most_common_pair(const std::vector<int>& word) const {
-    if (word.size() < 2) {
-        return {0, 0};
+namespace {
+
+using detail::MergeCandidate;
+using detail::Symbol;
+
+// Orders the min-heap by rank first, then leftmost position.
+struct CandidateGreater {
+    bool operator()(const MergeCandidate& a, const MergeCandidate& b) const noexcept {
+        if (a.rank != b.rank) return a.rank > b.rank;
+        return a.left > b.left;
+    }
+};
+
+#if TKNZR_METRICS
+// Capacities only grow, so a change in the sum means some buffer allocated
+size_t scratch_capacity(const EncodeScratch& scratch) noexcept {
+    return scratch.symbols.capacity() + scratch.heap.capacity() + scratch.batch.capacity() +
+           scratch.pending.capacity() + scratch.dead.capacity() + scratch.word.capacity();
+}
+#endif
+
+} // namespace
+
+void Tokenizer::bpe_encode(std::string_view piece, EncodeScratch& scratch) const {
+    TKNZR_METRIC_SAMPLE_SCOPE(Merge);
+    TKNZR_METRICS_ONLY(const size_t capacity_before = scratch_capacity(scratch);)
+    TokenList& word = scratch.word;
+    word.clear();
+    if (piece.size() < 2 || merges_.empty()) {
+        // Nothing to merge, return bytes as tokens
+        for (unsigned char c : piece) {
+            word.push_back(byte_tokens_[c]);
+        }
+        return;
     }
     
-    std::unordered_map<Pair, int, PairHash> pair_counts;
-    for (size_t i = 0; i < word.size() - 1; ++i) {
-        pair_counts[{word[i], word[i + 1]}]++;
+    if (backtrack_) {
+        backtrack_->encode(piece, word, scratch.dead);
+    } else {
+        merge_by_rank(piece, scratch);
+    }
+    TKNZR_METRIC_ADD(Merges, piece.size() - word.size());
+    TKNZR_METRICS_ONLY(if (scratch_capacity(scratch) != capacity_before) metrics::add(Counter::ScratchGrowths, 1);)
+}
+
+void Tokenizer::merge_by_rank(std::string_view piece, EncodeScratch& scratch) const {
+    TokenList& word = scratch.word;
+    const int n = static_cast<int>(piece.size());
+    std::vector<Symbol>& symbols = scratch.symbols;
+    symbols.resize(n);
+    for (int i = 0; i < n; ++i) {
+        symbols[i] = {byte_tokens_[static_cast<unsigned char>(piece[i])], i - 1, i + 1 < n ? i + 1 : -1, 1};
     }
     
-    Pair best_pair = {word[0], word[1]};
-    int best_count = 0;
+    std::vector<MergeCandidate>& heap = scratch.heap;
+    std::vector<MergeCandidate>& batch = scratch.batch;
+    std::vector<MergeCandidate>& pending = scratch.pending;
+    heap.clear();
+    CandidateGreater cmp;
     
-    for (const auto& [pair, count] : pair_counts) {
-        if (count > best_count) {
-            best_pair = pair;
-            best_count = count;
+    auto queue_pair = [&](std::vector<MergeCandidate>& out, int left, int right) {
+        if (const MergeIndex::Entry* merge = merges_.find(symbols[left].token, symbols[right].token)) {
+            out.push_back({merge->rank, merge->token, left, right, symbols[left].len + symbols[right].len});
         }
+    };
+    
+    for (int i = 0; i + 1 < n; ++i) {
+        queue_pair(heap, i, i + 1);
     }
+    std::make_heap(heap.begin(), heap.end(), cmp);
+    
+    // Merges of one rank are applied left to right as a single pass before
+    // any pair they create is considered, which matches the original
+    // "apply the lowest ranked pair everywhere, then rescan" semantics.
+    while (!heap.empty()) {
+        const int rank = heap.front().rank;
+        batch.clear();
+        while (!heap.empty() && heap.front().rank == rank) {
+            std::pop_heap(heap.begin(), heap.end(), cmp);
+            batch.push_back(heap.back());
+            heap.pop_back();
+        }
     
-    return best_pair;
-}
-
-std::vector<int> Tokenizer::apply_merge(const std::vector<int>& word, const Pair& pair, Token new_token) const {
-    if (word.size() < 2) return word;
+        pending.clear();
+        for (const MergeCandidate& c : batch) {
+            Symbol& left = symbols[c.left];
+            Symbol& right = symbols[c.right];
+            if (left.next != c.right || left.len + right.len != c.len) {
+                continue; // Stale: one side was merged since this was queued
+            }
     
-    std::vector<int> new_word;
-    new_word.reserve(word.size());
+            left.token = c.token;
+            left.len = c.len;
+            left.next = right.next;
+            if (right.next != -1) {
+                symbols[right.next].prev = c.left;
+            }
+            right.len = 0;
+            right.next = -1;
     
-    size_t i = 0;
-    while (i < word.size()) {
-        if (i < word.size() - 1 && word[i] == pair.first && word[i + 1] == pair.second) {
-            new_word.push_back(new_token);
-            i += 2;
-        } else {
-            new_word.push_back(word[i]);
-            i++;
+            if (left.prev != -1) {
+                queue_pair(pending, left.prev, c.left);
+            }
+            if (left.next != -1) {
+                queue_pair(pending, c.left, left.next);
+            }
+        }
+    
+        for (const MergeCandidate& c : pending) {
+            heap.push_back(c);
+            std::push_heap(heap.begin(), heap.end(), cmp);
         }
     }
     
-    return new_word;
+    for (int i = 0; i != -1; i = symbols[i].next) {
+        word.push_back(symbols[i].token);
+    }
 }
 
-std::vector<Token> Tokenizer::bpe_encode(const std::vector<int>& word_bytes) const {
-    if (word_bytes.empty()) return {};
-    if (word_bytes.size() == 1) return {word_bytes[0]};
-    if (merge_ranks_.empty()) {
-        // No merges learned, return bytes as tokens
-        std::vector<Token> tokens;
-        tokens.reserve(word_bytes.size());
-        for (int b : word_bytes) {
-            tokens.push_back(b);
+std::span<const Token> Tokenizer::encode_piece(std::string_view piece, EncodeScratch& scratch) const {
+    TKNZR_METRIC_ADD(Pieces, 1);
+    TKNZR_METRIC_ADD(BytesIn, piece.size());
+    EncodeCache* cache = cache_.get();
+    const bool cacheable = cache && cache->cacheable(piece);
+    if (cacheable) {
+        scratch.word.clear();
+        bool hit;
+        {
+            TKNZR_METRIC_SAMPLE_SCOPE(CacheLookup);
+            hit = cache->lookup(piece, scratch.word);
         }
+        if (hit) {
+            TKNZR_METRIC_ADD(CacheHits, 1);
+            TKNZR_METRIC_ADD(TokensOut, scratch.word.size());
+            return scratch.word;
+        }
+        TKNZR_METRIC_ADD(CacheMisses, 1);
+    }
+    
+    bpe_encode(piece, scratch);
+    if (cacheable) {
+        cache->insert(piece, scratch.word);
+    }
+    TKNZR_METRIC_ADD(TokensOut, scratch.word.size());
+    return scratch.word;
+}
+
+template <typename Sink>
+void Tokenizer::encode_pieces(std::string_view text, EncodeScratch& scratch, Sink&& sink) const {
+    TKNZR_METRIC_ADD(EncodeCalls, 1);
+    TKNZR_METRIC_TIME_SCOPE(Encode);
+    TKNZR_METRICS_ONLY(metrics::ScanTimer scan;)
+    pretokenizer_.for_each_piece(text, [&](std::string_view piece) {
+        TKNZR_METRICS_ONLY(scan.scanned();)
+        sink(encode_piece(piece, scratch));
+        TKNZR_METRICS_ONLY(scan.next();)
+    });
+}
+
+TokenList Tokenizer::encode(std::string_view text) const {
+    TokenList tokens;
+    encode_append(text, tokens);
+    return tokens;
+}
+
+EncodeScratch& Tokenizer::thread_scratch() {
+    thread_local EncodeScratch scratch;
+    return scratch;
+}
+
+TokenList Tokenizer::encode_with_special(std::string_view text, const SpecialSet& allowed,
+                                         const SpecialSet& disallowed) const {
+    TokenList tokens;
+    if (!specials_) {
+        encode_append(text, tokens);
         return tokens;
     }
     
-    std::vector<int> word = word_bytes;
-    
-    // Apply merges in order of rank (lower rank = higher priority)
-    std::vector<std::pair<int, Pair>> sorted_merges;
-    for (const auto& [pair, rank] : merge_ranks_) {
-        sorted_merges.emplace_back(rank, pair);
-    }
-    std::sort(sorted_merges.begin(), sorted_merges.end());
-    
-    // Keep merging until no more merges can be applied
-    while (word.size() > 1) {
-        bool merged = false;
-        
-        // Find the highest priority merge that exists in the word
-        for (const auto& [rank, pair] : sorted_merges) {
-            // Check if this pair exists in the word
-            bool pair_exists = false;
-            for (size_t i = 0; i < word.size() - 1; ++i) {
-                if (word[i] == pair.first && word[i + 1] == pair.second) {
-                    pair_exists = true;
-                    break;
-                }
-            }
-            
-            if (pair_exists) {
-                // Apply this merge
-                Token new_token = 256 + rank;
-                word = apply_merge(word, pair, new_token);
-                merged = true;
-                break; // Start over with the new word
-            }
+    size_t segment = 0;  // Start of the ordinary text not yet encoded
+    size_t pos = 0;
+    while (auto match = specials_->find(text, pos)) {
+        const std::string_view name = text.substr(match->begin, match->length);
+        if (allowed.contains(name)) {
+            encode_append(text.substr(segment, match->begin - segment), tokens);
+            tokens.push_back(match->token);
+            segment = pos = match->begin + match->length;
+        } else if (disallowed.contains(name)) {
+            throw std::invalid_argument("encode_with_special: disallowed special token " + std::string(name));
+        } else {
+            pos = match->begin + 1;  // Ordinary text; look for the next one
+        }
+    }
+    encode_append(text.substr(segment), tokens);
+    return tokens;
+}
+
+void Tokenizer::add_special_token(std::string_view text, Token id) {
+    const Token first_free = 256 + static_cast<Token>(merges_.size());
+    if (id < first_free) {
+        throw std::invalid_argument("add_special_token: id is taken by a BPE token");
+    }
+    if (id - first_free >= kMaxSpecialGap) {
+        throw std::invalid_argument("add_special_token: id too far past the BPE tokens");
+    }
+    auto specials = specials_ ? std::make_shared<SpecialTokens>(*specials_) : std::make_shared<SpecialTokens>();
+    if (!specials->add(text, id)) {
+        throw std::invalid_argument("add_special_token: empty or already registered: " + std::string(text));
+    }
+    if (!token_bytes_.set(id, text)) {
+        throw std::invalid_argument("add_special_token: token bytes exceed the arena limit");
+    }
+    specials_ = std::move(specials);
+}
+
+std::optional<Token> Tokenizer::special_token(std::string_view text) const {
+    return specials_ ? specials_->token_of(text) : std::nullopt;
+}
+
+std::vector<std::pair<std::string, Token>> Tokenizer::special_tokens() const {
+    return specials_ ? specials_->entries() : std::vector<std::pair<std::string, Token>>{};
+}
+
+void Tokenizer::encode_append(std::string_view text, TokenList& tokens) const {
+    encode_pieces(text, thread_scratch(), [&](std::span<const Token> piece_tokens) {
+        tokens.insert(tokens.end(), piece_tokens.begin(), piece_tokens.end());
+    });
+}
+
+size_t Tokenizer::token_width() const {
+    // token_bytes_ spans every id up to the largest special token
+    const size_t ids = std::max(token_bytes_.size(), 256 + merges_.size());
+    return ids <= size_t{1} << 16 ? 2 : 4;
+}
+
+void Tokenizer::encode_compact(std::string_view text, std::vector<uint16_t>& out) const {
+    if (token_width() > sizeof(uint16_t)) {
+        throw std::length_error("encode_compact: token ids do not fit in 16 bits");
+    }
+    out.clear();
+    encode_pieces(text, thread_scratch(), [&](std::span<const Token> piece_tokens) {
+        out.insert(out.end(), piece_tokens.begin(), piece_tokens.end());
+    });
+}
+
+void Tokenizer::encode_compact(std::string_view text, std::vector<uint32_t>& out) const {
+    out.clear();
+    encode_pieces(text, thread_scratch(), [&](std::span<const Token> piece_tokens) {
+        out.insert(out.end(), piece_tokens.begin(), piece_tokens.end());
+    });
+}
+
+size_t Tokenizer::count_tokens(std::string_view text) const {
+    // Pieces are merged in the thread's scratch and only their lengths kept
+    size_t count = 0;
+    encode_pieces(text, thread_scratch(), [&](std::span<const Token> piece_tokens) {
+        count += piece_tokens.size();
+    });
+    return count;
+}
+
+size_t Tokenizer::encode_into(std::string_view text, std::span<Token> out, EncodeScratch& scratch) const {
+    size_t needed = 0;
+    encode_pieces(text, scratch, [&](std::span<const Token> piece_tokens) {
+        if (needed < out.size()) {
+            const size_t n = std::min(piece_tokens.size(), out.size() - needed);
+            std::copy_n(piece_tokens.begin(), n, out.begin() + needed);
         }
-        
-        if (!merged) {
-            // No more merges can be applied
-            break;
+        needed += piece_tokens.size();
+    });
+    return needed;
+}
+
+TokenList Tokenizer::encode_truncated(std::string_view text, size_t max_tokens, TruncationSide side) const {
+    TokenList tokens;
+    EncodeScratch& scratch = thread_scratch();
+    
+    if (side == TruncationSide::Head) {
+        while (!text.empty() && tokens.size() < max_tokens) {
+            const size_t length = pretokenizer_.next_piece(text);
+            const std::span<const Token> piece_tokens = encode_piece(text.substr(0, length), scratch);
+            tokens.insert(tokens.end(), piece_tokens.begin(), piece_tokens.end());
+            text.remove_prefix(length);
         }
+        if (tokens.size() > max_tokens) tokens.resize(max_tokens);
+        return tokens;
     }
     
-    std::vector<Token> tokens;
-    tokens.reserve(word.size());
-    for (int w : word) {
-        tokens.push_back(w);
+    // Piece boundaries need a forward scan, but that is cheap next to
+    // merging; pieces are then merged from the end, tokens collected reversed
+    std::vector<size_t> starts;
+    for (size_t pos = 0; pos < text.size(); pos += pretokenizer_.next_piece(text.substr(pos))) {
+        starts.push_back(pos);
+    }
+    size_t end = text.size();
+    for (auto it = starts.rbegin(); it != starts.rend() && tokens.size() < max_tokens; ++it) {
+        const std::span<const Token> piece_tokens = encode_piece(text.substr(*it, end - *it), scratch);
+        tokens.insert(tokens.end(), piece_tokens.rbegin(), piece_tokens.rend());
+        end = *it;
     }
+    if (tokens.size() > max_tokens) tokens.resize(max_tokens);
+    std::reverse(tokens.begin(), tokens.end());
     return tokens;
 }
 
-std::vector<int> Tokenizer::bpe_decode(const std::vector<Token>& tokens) const {
-    if (tokens.empty()) return {};
+namespace {
+
+// Whether the last character of text is whitespace; a stray continuation
+// byte counts as Other, like in the pre-tokenizer
+bool ends_in_whitespace(std::string_view text) noexcept {
+    if (text.empty()) return false;
+    size_t start = text.size() - 1;
+    while (start > 0 && text.size() - start < 4 && (static_cast<unsigned char>(text[start]) & 0xC0) == 0x80) {
+        start--;
+    }
+    const unicode::DecodedChar c = unicode::decode(text, start);
+    return start + c.length == text.size() && c.cls == unicode::CharClass::Space;
+}
+
+} // namespace
+
+WindowedEncoding Tokenizer::encode_windows(std::string_view text, size_t window, size_t stride) const {
+    if (window == 0 || stride == 0) {
+        throw std::invalid_argument("encode_windows: window and stride must be positive");
+    }
     
-    std::vector<int> result;
-    result.reserve(tokens.size() * 2); // Rough estimate
+    // One pass records where each piece starts, in tokens and in bytes
+    WindowedEncoding result;
+    std::vector<size_t> piece_tokens_at;
+    std::vector<size_t> piece_bytes_at;
+    size_t byte = 0;
+    encode_pieces(text, thread_scratch(), [&](std::span<const Token> piece_tokens) {
+        piece_tokens_at.push_back(result.tokens.size());
+        piece_bytes_at.push_back(byte);
+        for (Token token : piece_tokens) byte += token_bytes_[token].size();
+        result.tokens.insert(result.tokens.end(), piece_tokens.begin(), piece_tokens.end());
+    });
+    const size_t total = result.tokens.size();
+    piece_tokens_at.push_back(total);
+    piece_bytes_at.push_back(text.size());
+    
+    // A window may end after a piece only if the text up to there scans
+    // alone into the same pieces. Lookaheads such as \s+(?!\S) only see past
+    // a piece that ends in whitespace, so boundaries after any other piece
+    // (and the end of the text) qualify.
+    std::vector<size_t> stable_ends;
+    for (size_t piece = 0; piece + 1 < piece_tokens_at.size(); ++piece) {
+        const size_t begin = piece_bytes_at[piece];
+        if (piece + 2 == piece_tokens_at.size() ||
+            !ends_in_whitespace(text.substr(begin, piece_bytes_at[piece + 1] - begin))) {
+            stable_ends.push_back(piece_tokens_at[piece + 1]);
+        }
+    }
     
-    for (Token token : tokens) {
-        if (token < 256) {
-            // Base byte token
-            result.push_back(token);
-        } else {
-            // Look up merge rule
-            auto it = merges_.find(token);
-            if (it != merges_.end()) {
-                const Pair& pair = it->second;
-                // Recursively decode the pair
-                std::vector<Token> pair_tokens = {pair.first, pair.second};
-                std::vector<int> decoded_pair = bpe_decode(pair_tokens);
-                result.insert(result.end(), decoded_pair.begin(), decoded_pair.end());
-            } else {
-                // Unknown token, treat as byte (shouldn't happen in valid vocab)
-                if (token < 256) {
-                    result.push_back(token);
-                }
+    // Byte offset of a token, which may sit inside a piece
+    auto byte_of = [&](size_t token) {
+        const size_t piece = std::upper_bound(piece_tokens_at.begin(), piece_tokens_at.end(), token) -
+                             piece_tokens_at.begin() - 1;
+        size_t offset = piece_bytes_at[piece];
+        for (size_t t = piece_tokens_at[piece]; t < token; ++t) offset += token_bytes_[result.tokens[t]].size();
+        return offset;
+    };
+    // Last boundary of a sorted list in (after, limit], or 0 if there is none
+    auto last_boundary = [](const std::vector<size_t>& boundaries, size_t after, size_t limit) -> size_t {
+        auto it = std::upper_bound(boundaries.begin(), boundaries.end(), limit);
+        return it != boundaries.begin() && *(it - 1) > after ? *(it - 1) : 0;
+    };
+    
+    // When every piece in (begin, limit] ends in whitespace, the last
+    // boundary there whose prefix rescans from begin into the same pieces,
+    // or 0 if there is none (or begin is inside a piece)
+    auto whitespace_end = [&](size_t begin, size_t limit) -> size_t {
+        auto first = std::lower_bound(piece_tokens_at.begin(), piece_tokens_at.end(), begin);
+        if (*first != begin) return 0;
+        auto last = std::upper_bound(first, piece_tokens_at.end(), limit);
+        const size_t start = piece_bytes_at[first - piece_tokens_at.begin()];
+        for (auto candidate = last - 1; candidate > first; --candidate) {
+            const size_t piece_end = piece_bytes_at[candidate - piece_tokens_at.begin()];
+            const std::string_view prefix = text.substr(start, piece_end - start);
+            size_t pos = 0;
+            auto expected = first + 1;
+            while (pos < prefix.size()) {
+                pos += pretokenizer_.next_piece(prefix.substr(pos));
+                if (start + pos != piece_bytes_at[expected - piece_tokens_at.begin()]) break;
+                ++expected;
             }
+            if (pos == prefix.size() && expected == candidate + 1) return *candidate;
+        }
+        return 0;
+    };
+    
+    for (size_t begin = 0; begin < total;) {
+        const size_t limit = std::min(begin + window, total);
+        size_t end = last_boundary(stable_ends, begin, limit);
+        if (end == 0) end = whitespace_end(begin, limit);
+        if (end == 0) end = last_boundary(piece_tokens_at, begin, limit);
+        if (end == 0) end = begin + window;  // A piece longer than the window
+        result.windows.push_back({byte_of(begin), byte_of(end), begin, end});
+        if (end == total) break;
+    
+        // A window cut short of a full one must not leave a gap before the next
+        const size_t step = std::min(begin + stride, end);
+        size_t next = last_boundary(piece_tokens_at, begin, step);
+        if (next == 0) {
+            next = *std::upper_bound(piece_tokens_at.begin(), piece_tokens_at.end(), begin);
+            if (next > end) next = step;  // Still inside a long piece
         }
+        begin = next;
     }
-    
     return result;
 }
 
-TokenList Tokenizer::encode(const std::string& text) const {
-    if (text.empty()) return {};
-    
-    // Convert text to bytes
-    std::vector<int> bytes = text_to_bytes(text);
-    
-    // Apply BPE encoding
-    std::vector<Token> tokens = bpe_encode(bytes);
+namespace {
+
+// Task order for the pool: largest first, so long documents start early
+// and short ones fill in around them
+template <typename SizeOf>
+std::vector<size_t> largest_first(size_t count, SizeOf size_of) {
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return size_of(a) > size_of(b); });
+    return order;
+}
+
+} // namespace
+
+BatchEncoding Tokenizer::encode_batch(std::span<const std::string_view> texts) const {
+    BatchEncoding batch;
+    batch.offsets.assign(texts.size() + 1, 0);
+    if (texts.empty()) return batch;
+    
+    // Each worker appends into its own buffer; documents remember where
+    // their tokens landed so the results can be stitched back in order
+    struct Placement {
+        size_t worker;
+        size_t begin;
+        size_t end;
+    };
+    ThreadPool& pool = thread_pool();
+    std::vector<TokenList> worker_tokens(pool.size());
+    std::vector<Placement> placements(texts.size());
+    
+    pool.parallel_for(largest_first(texts.size(), [&](size_t i) { return texts[i].size(); }),
+        [&](size_t i, size_t worker) {
+            TokenList& out = worker_tokens[worker];
+            const size_t begin = out.size();
+            encode_append(texts[i], out);
+            placements[i] = {worker, begin, out.size()};
+        });
+    
+    for (size_t i = 0; i < texts.size(); ++i) {
+        batch.offsets[i + 1] = batch.offsets[i] + (placements[i].end - placements[i].begin);
+    }
+    batch.tokens.resize(batch.offsets.back());
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const Placement& p = placements[i];
+        std::copy(worker_tokens[p.worker].begin() + p.begin, worker_tokens[p.worker].begin() + p.end,
+                  batch.tokens.begin() + batch.offsets[i]);
+    }
+    return batch;
+}
+
+TokenList Tokenizer::encode_parallel(std::string_view text, size_t chunk_bytes) const {
+    chunk_bytes = std::max<size_t>(chunk_bytes, 1);
+    std::vector<std::string_view> chunks;
+    size_t begin = 0;
+    while (text.size() - begin > chunk_bytes) {
+        const size_t end = pretokenizer_.boundary_after(text, begin + chunk_bytes);
+        if (end == text.size()) break;
+        chunks.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    if (chunks.empty()) return encode(text);
+    chunks.push_back(text.substr(begin));
     
-    return tokens;
+    // Chunks are encoded like separate documents and come back in order
+    return encode_batch(chunks).tokens;
+}
+
+std::vector<size_t> Tokenizer::count_tokens_batch(std::span<const std::string_view> texts) const {
+    std::vector<size_t> counts(texts.size());
+    thread_pool().parallel_for(largest_first(texts.size(), [&](size_t i) { return texts[i].size(); }),
+        [&](size_t i, size_t) {
+            counts[i] = count_tokens(texts[i]);
+        });
+    return counts;
+}
+
+std::vector<std::string> Tokenizer::decode_batch(const BatchEncoding& batch) const {
+    std::vector<std::string> texts(batch.size());
+    thread_pool().parallel_for(largest_first(batch.size(), [&](size_t i) { return batch[i].size(); }),
+        [&](size_t i, size_t) {
+            decode_into(batch[i], texts[i]);
+        });
+    return texts;
+}
+
+void Tokenizer::set_num_threads(size_t threads) {
+    if (threads == 0) {
+        pool_.reset();
+    } else {
+        pool_ = std::make_shared<ThreadPool>(threads);
+    }
+}
+
+size_t Tokenizer::num_threads() const {
+    return thread_pool().size();
+}
+
+ThreadPool& Tokenizer::thread_pool() const {
+    return pool_ ? *pool_ : ThreadPool::shared();
 }
 
 std::string Tokenizer::decode(const TokenList& tokens) const {
-    if (tokens.empty()) return "";
-    
-    // Decode tokens back to bytes
-    std::vector<int> bytes = bpe_decode(tokens);
+    std::string text;
+    decode_into(tokens, text);
+    return text;
+}
+
+void Tokenizer::decode_into(std::span<const Token> tokens, std::string& out) const {
+    decode_ids(tokens, out);
+}
+
+void Tokenizer::decode_into(std::span<const uint16_t> tokens, std::string& out) const {
+    decode_ids(tokens, out);
+}
+
+void Tokenizer::decode_into(std::span<const uint32_t> tokens, std::string& out) const {
+    decode_ids(tokens, out);
+}
+
+template <typename T>
+void Tokenizer::decode_ids(std::span<const T> tokens, std::string& out) const {
+    TKNZR_METRIC_TIME_SCOPE(Decode);
+    size_t total = 0;
+    for (T token : tokens) {
+        total += token_bytes_[static_cast<Token>(token)].size();
+    }
     
-    // Convert bytes to text
-    return bytes_to_text(bytes);
+    out.resize(total);
+    char* dest = out.data();
+    for (T token : tokens) {
+        const std::string_view bytes = token_bytes_[static_cast<Token>(token)];
+        std::memcpy(dest, bytes.data(), bytes.size());
+        dest += bytes.size();
+    }
+    TKNZR_METRIC_ADD(DecodeCalls, 1);
+    TKNZR_METRIC_ADD(DecodeTokens, tokens.size());
+    TKNZR_METRIC_ADD(BytesOut, total);
 }
 
 bool Tokenizer::load_from_tiktoken_binary(const std::vector<uint8_t>& binary_data) {
@@ -279,64 +625,54 @@ bool Tokenizer::load_from_tiktoken_binary(const std::vector<uint8_t>& binary_dat
         return false; // Must be multiple of 4 bytes (2 uint16_t per merge)
     }
     
-    merges_.clear();
-    merge_ranks_.clear();
+    std::vector<Pair> merges;
+    merges.reserve(binary_data.size() / 4);
     
-    Token rank = 0;
     for (size_t i = 0; i + 3 < binary_data.size(); i += 4) {
         // Read two little-endian uint16_t values
         uint16_t token1 = static_cast<uint16_t>(binary_data[i]) | 
                          (static_cast<uint16_t>(binary_data[i + 1]) << 8);
         uint16_t token2 = static_cast<uint16_t>(binary_data[i + 2]) | 
                          (static_cast<uint16_t>(binary_data[i + 3]) << 8);
-        
-        Token new_token = 256 + rank;
-        Pair pair = {static_cast<Token>(token1), static_cast<Token>(token2)};
-        
-        merges_[new_token] = pair;
-        merge_ranks_[pair] = rank;
-        rank++;
+    
+        merges.emplace_back(static_cast<Token>(token1), static_cast<Token>(token2));
     }
     
+    if (!freeze_vocabulary(std::move(merges))) return false;
     vocab_size_ = 256 + merges_.size();
     return !merges_.empty();
 }
 
 bool Tokenizer::load_from_base64(const std::string& base64_merges) {
+    if (is_tiktoken(base64_merges)) {
+        return load_tiktoken(base64_merges);
+    }
+    
     std::string decoded = base64_decode(base64_merges);
     
     // First, try tiktoken binary format (little-endian uint16_t pairs)
     // This is the format used by GPT-4/cl100k_base
     if (decoded.size() >= 4 && decoded.size() % 4 == 0) {
         std::vector<uint8_t> binary_data(decoded.begin(), decoded.end());
-        if (load_from_tiktoken_binary(binary_data)) {
-            return true;
-        }
+        return load_from_tiktoken_binary(binary_data);
     }
     
     // Fall back to text format: try parsing as space-separated token pairs
     std::istringstream iss(decoded);
     std::string line;
-    Token rank = 0;
-    
-    merges_.clear();
-    merge_ranks_.clear();
+    std::vector<Pair> merges;
     
     while (std::getline(iss, line)) {
         if (line.empty()) continue;
-        
+    
         std::istringstream line_stream(line);
         std::string token1_str, token2_str;
-        
+    
         if (line_stream >> token1_str >> token2_str) {
             try {
                 Token token1 = std::stoi(token1_str);
                 Token token2 = std::stoi(token2_str);
-                Token new_token = 256 + rank;
-                
-                merges_[new_token] = {token1, token2};
-                merge_ranks_[{token1, token2}] = rank;
-                rank++;
+                merges.emplace_back(token1, token2);
             } catch (...) {
                 // Skip invalid lines
                 continue;
@@ -345,27 +681,25 @@ bool Tokenizer::load_from_base64(const std::string& base64_merges) {
     }
     
     // If text format worked, we're done
-    if (!merges_.empty()) {
+    if (!merges.empty()) {
+        if (!freeze_vocabulary(std::move(merges))) return false;
         vocab_size_ = 256 + merges_.size();
         return true;
     }
     
     // Last resort: try simple byte pairs (for very old formats)
     if (decoded.size() >= 2) {
-        rank = 0;
         for (size_t i = 0; i + 1 < decoded.size(); i += 2) {
             Token token1 = static_cast<unsigned char>(decoded[i]);
             Token token2 = static_cast<unsigned char>(decoded[i + 1]);
-            Token new_token = 256 + rank;
-            
-            merges_[new_token] = {token1, token2};
-            merge_ranks_[{token1, token2}] = rank;
-            rank++;
+            merges.emplace_back(token1, token2);
         }
+        if (!freeze_vocabulary(std::move(merges))) return false;
         vocab_size_ = 256 + merges_.size();
         return !merges_.empty();
     }
     
+    freeze_vocabulary({});
     return false;
 }
 
@@ -375,7 +709,17 @@ bool Tokenizer::load_from_file(const std::string& filepath) {
         return false;
     }
     
+    // Compiled tokenizer files are mapped rather than parsed, so only their
+    // magic is read here
+    char magic[16];
+    file.read(magic, sizeof(magic));
+    if (is_compiled({magic, static_cast<size_t>(file.gcount())})) {
+        file.close();
+        return load_compiled(filepath);
+    }
+    
     // Read file content
+    file.clear();
     file.seekg(0, std::ios::end);
     size_t file_size = file.tellg();
     file.seekg(0, std::ios::beg);
@@ -384,6 +728,11 @@ bool Tokenizer::load_from_file(const std::string& filepath) {
     file.read(reinterpret_cast<char*>(binary_data.data()), file_size);
     file.close();
     
+    std::string_view text(reinterpret_cast<const char*>(binary_data.data()), binary_data.size());
+    if (is_tiktoken(text)) {
+        return load_tiktoken(text);
+    }
+    
     // Try loading as tiktoken binary format first (GPT-4 compatible)
     if (file_size >= 4 && file_size % 4 == 0) {
         if (load_from_tiktoken_binary(binary_data)) {
@@ -397,49 +746,93 @@ bool Tokenizer::load_from_file(const std::string& filepath) {
 }
 
 void Tokenizer::train(const std::string& text, int vocab_size) {
-    vocab_size_ = vocab_size;
-    merges_.clear();
-    merge_ranks_.clear();
-    
-    // Convert text to bytes
-    std::vector<int> data = text_to_bytes(text);
-    
-    // Build vocabulary using BPE algorithm
-    std::vector<int> current_data = data;
-    Token next_token = 256;
-    
-    while (next_token < vocab_size && current_data.size() > 1) {
-        // Find most common pair
-        Pair mcp = get_most_common_pair(current_data);
-        
-        if (mcp.first == 0 && mcp.second == 0) {
-            break; // No more pairs to merge
-        }
-        
-        // Check if this pair already exists
-        if (merge_ranks_.find(mcp) != merge_ranks_.end()) {
-            break; // Already merged
-        }
-        
-        // Add merge rule
-        merges_[next_token] = mcp;
-        merge_ranks_[mcp] = next_token - 256;
-        
-        // Apply merge to data
-        current_data = apply_merge(current_data, mcp, next_token);
-        
+    // The whole byte stream is one word; merges only stop when no pair occurs
+    // more than zero times (see BpeTrainer for the tie-breaking rule)
+    BpeTrainer trainer;
+    trainer.add_word(text);
+    learn_merges(trainer, vocab_size);
+}
+
+void Tokenizer::train_pieces(std::span<const std::string_view> documents, int vocab_size) {
+    Trainer trainer(pretokenizer_.pattern(), std::numeric_limits<size_t>::max());
+    trainer.pool_ = pool_;  // Count on this tokenizer's workers (nullptr: the shared pool)
+    trainer.add_chunks(documents);
+    trainer.train(*this, vocab_size);
+}
+
+void Tokenizer::learn_merges(BpeTrainer& trainer, int vocab_size) {
+    Token next_token = static_cast<Token>(256 + trainer.merges().size());
+    while (next_token < vocab_size && trainer.merge_next()) {
         next_token++;
     }
     
+    freeze_vocabulary(trainer.merges());
     vocab_size_ = next_token;
 }
 
+bool Tokenizer::freeze_vocabulary(std::vector<Pair> merges, std::span<const uint8_t> base_bytes) {
+    MergeIndex index;
+    index.build(std::move(merges));
+    if (!token_bytes_.build(index, base_bytes)) return false;  // The current vocabulary stays
+    merges_ = std::move(index);
+    for (size_t token = 0; token < 256; ++token) {
+        byte_tokens_[base_bytes.empty() ? token : base_bytes[token]] = static_cast<Token>(token);
+    }
+    mapping_.reset();
+    specials_.reset();
+    reset_cache();
+    reset_encoder();
+    return true;
+}
+
+void Tokenizer::reset_cache() {
+    // Cached encodings belong to the previous vocabulary; copies of this
+    // tokenizer may still share the old cache, so start a fresh one
+    if (cache_) {
+        cache_ = std::make_shared<EncodeCache>(cache_->budget_bytes());
+    }
+}
+
+void Tokenizer::enable_cache(size_t budget_bytes) {
+    cache_ = std::make_shared<EncodeCache>(budget_bytes);
+}
+
+void Tokenizer::disable_cache() {
+    cache_.reset();
+}
+
+void Tokenizer::reset_encoder() {
+    // A vocabulary the backtracking engine cannot handle falls back to the heap
+    backtrack_ = algorithm_ == BpeAlgorithm::Backtracking ? BacktrackEncoder::build(merges_, token_bytes_) : nullptr;
+}
+
+void Tokenizer::set_bpe_algorithm(BpeAlgorithm algorithm) {
+    algorithm_ = algorithm;
+    reset_encoder();
+}
+
+BpeAlgorithm Tokenizer::bpe_algorithm() const {
+    return backtrack_ ? BpeAlgorithm::Backtracking : BpeAlgorithm::Heap;
+}
+
+CacheStats Tokenizer::cache_stats() const {
+    return cache_ ? cache_->stats() : CacheStats{};
+}
+
+void Tokenizer::set_split_pattern(SplitPattern pattern) {
+    pretokenizer_ = PreTokenizer(pattern);
+}
+
+SplitPattern Tokenizer::split_pattern() const {
+    return pretokenizer_.pattern();
+}
+
 size_t Tokenizer::vocab_size() const {
     return vocab_size_;
 }
 
-const std::unordered_map<Token, Pair>& Tokenizer::get_merges() const {
-    return merges_;
+MergesView Tokenizer::get_merges() const {
+    return MergesView(merges_.pairs());
 }
 
 // ============================================================================
@@ -451,7 +844,7 @@ void tokenize(const std::string& bytestream) {
 }
 
 size_t PairHash::operator()(const Pair& p) const noexcept {
-    return (std::hash<int>()(p.first) << 1) ^ std::hash<int>()(p.second);
+    return static_cast<size_t>(hash_pair_key(pack_pair(p.first, p.second)));
 }
 
 std::unordered_map<Pair, int, PairHash> create_pairs(const std::string& bytestream) {
@@ -473,51 +866,51 @@ std::unordered_map<Pair, int, PairHash> create_pairs(const std::vector<int>& byt
 
 Pair get_most_common_pair(const std::string& bytestream) {
     std::unordered_map<Pair, int, PairHash> pairs = create_pairs(bytestream);
-
+    
     Pair best_pair = {0, 0};
     int best_pair_counter = 0;
-
+    
     for (const auto& [pair, count] : pairs) {
         if (count > best_pair_counter) {
             best_pair = pair;
             best_pair_counter = count;
         }
     }
-
+    
     return best_pair;
 }
 
 Pair get_most_common_pair(const std::vector<int>& bytestream) {
     std::unordered_map<Pair, int, PairHash> pairs = create_pairs(bytestream);
-
+    
     Pair best_pair = {0, 0};
     int best_pair_counter = 0;
-
+    
     for (const auto& [pair, count] : pairs) {
         if (count > best_pair_counter) {
             best_pair = pair;
             best_pair_counter = count;
         }
     }
-
+    
     return best_pair;
 }
 
 std::vector<int> convert_bytestream_to_vector(const std::string& bytestream) {
     std::vector<int> vec;
     vec.reserve(bytestream.size());
-
+    
     for(unsigned char c : bytestream) {
         vec.emplace_back(static_cast<int>(c));
     }
-
+    
     return vec;
 }
 
 std::vector<int> swap_pairs_with_value(const std::vector<int>& data, const Pair& pair, int new_key) {
     std::vector<int> new_vector;
     new_vector.reserve(data.size());
-
+    
     size_t i = 0;
     while(i < data.size()) {
         if (i < data.size() - 1) {
@@ -533,7 +926,7 @@ std::vector<int> swap_pairs_with_value(const std::vector<int>& data, const Pair&
             i++;
         }
     }
-
+    
     return new_vector;
 }
 
@@ -542,14 +935,14 @@ std::unordered_map<int, Pair> create_vocab_n_sized(const std::vector<int>& data,
     std::unordered_map<int, Pair> vocab;
     
     std::vector<int> buff = data;
-
+    
     for(int i = 0; i < n - 256 && buff.size() > 1; ++i) {
         Pair mcp = get_most_common_pair(buff);  // Fixed: use buff instead of data
-        
+    
         if (mcp.first == 0 && mcp.second == 0) {
             break; // No more pairs
         }
-        
+    
         buff = swap_pairs_with_value(buff, mcp, 256 + i);
         vocab[256 + i] = mcp;
     }
@@ -0,0 +1,147 @@
+#include "tknzr/token_bytes.hpp"
+#include <utility>
+
+namespace tknzr {
+
+namespace {
+
+enum class State : uint8_t { Pending, Expanding, Done };
+
+} // namespace
+
+TokenBytes::TokenBytes(const TokenBytes& other) {
+    *this = other;
+}
+
+TokenBytes& TokenBytes::operator=(const TokenBytes& other) {
+    if (this == &other) return *this;
+    arena_storage_ = other.arena_storage_;
+    span_storage_ = other.span_storage_;
+    if (other.owned()) {
+        arena_ = arena_storage_;
+        spans_ = span_storage_;
+    } else {
+        arena_ = other.arena_;
+        spans_ = other.spans_;
+    }
+    return *this;
+}
+
+bool TokenBytes::attach(std::string_view arena, std::span<const Span> spans) {
+    for (const Span& span : spans) {
+        if (span.offset > arena.size() || span.length > arena.size() - span.offset) {
+            return false;
+        }
+    }
+    arena_storage_.clear();
+    span_storage_.clear();
+    arena_ = arena;
+    spans_ = spans;
+    return true;
+}
+
+bool TokenBytes::set(Token token, std::string_view bytes) {
+    if (bytes.size() > kMaxArenaBytes - arena_.size()) return false;
+    if (!owned()) {
+        arena_storage_.assign(arena_);
+        span_storage_.assign(spans_.begin(), spans_.end());
+    }
+    if (static_cast<size_t>(token) >= span_storage_.size()) {
+        span_storage_.resize(static_cast<size_t>(token) + 1, Span{0, 0});
+    }
+    span_storage_[token] = {static_cast<uint32_t>(arena_storage_.size()), static_cast<uint32_t>(bytes.size())};
+    arena_storage_.append(bytes);
+    arena_ = arena_storage_;
+    spans_ = span_storage_;
+    return true;
+}
+
+bool TokenBytes::build(const MergeIndex& merges, std::span<const uint8_t> base_bytes) {
+    const size_t count = 256 + merges.size();
+    std::vector<uint64_t> lengths(count, 0);
+    std::vector<uint8_t> parts(count, 0);  // Bit 0/1: first/second part contributes
+    std::vector<Token> order;  // Merged tokens, each after the parts it uses
+    order.reserve(merges.size());
+    std::vector<State> state(count, State::Pending);
+    for (size_t b = 0; b < 256; ++b) {
+        lengths[b] = 1;
+        state[b] = State::Done;
+    }
+    
+    auto known = [&](Token token) {
+        return token >= 0 && static_cast<size_t>(token) < count;
+    };
+    
+    // Sizes come first, so a chain of self-doubling merges is rejected
+    // before anything is expanded. Merges normally refer to lower ids, so
+    // visiting in id order finds both parts ready; forward references fall
+    // back to an explicit DFS.
+    std::vector<Token> stack;
+    uint64_t total = 256;
+    for (size_t root = 256; root < count; ++root) {
+        if (state[root] == State::Done) continue;
+        stack.push_back(static_cast<Token>(root));
+    
+        while (!stack.empty()) {
+            const Token token = stack.back();
+            const Pair& pair = *merges.pair_of(token);
+            if (state[token] == State::Pending) {
+                state[token] = State::Expanding;
+                for (Token part : {pair.second, pair.first}) {
+                    if (known(part) && state[part] == State::Pending) {
+                        stack.push_back(part);
+                    }
+                }
+                continue;
+            }
+    
+            stack.pop_back();
+            if (state[token] == State::Done) continue;
+            // A part still Expanding is a cycle back to an ancestor; it
+            // contributes nothing
+            uint64_t length = 0;
+            if (known(pair.first) && state[pair.first] == State::Done) {
+                parts[token] |= 1;
+                length += lengths[pair.first];
+            }
+            if (known(pair.second) && state[pair.second] == State::Done) {
+                parts[token] |= 2;
+                length += lengths[pair.second];
+            }
+            // Lengths stay below 2 * kMaxArenaBytes, so the sums cannot wrap
+            total += length;
+            if (total > kMaxArenaBytes) return false;
+            lengths[token] = length;
+            state[token] = State::Done;
+            order.push_back(token);
+        }
+    }
+    
+    std::string& arena = arena_storage_;
+    std::vector<Span>& spans = span_storage_;
+    arena.clear();
+    arena.reserve(total);
+    spans.assign(count, Span{0, 0});
+    for (size_t b = 0; b < 256; ++b) {
+        spans[b] = {static_cast<uint32_t>(arena.size()), 1};
+        arena.push_back(static_cast<char>(base_bytes.empty() ? b : base_bytes[b]));
+    }
+    auto append = [&](Token token) {
+        // Copy via offsets: the arena may reallocate while appending
+        const Span part = spans[token];
+        arena.append(arena, part.offset, part.length);
+    };
+    for (Token token : order) {
+        const Pair& pair = *merges.pair_of(token);
+        const size_t offset = arena.size();
+        if (parts[token] & 1) append(pair.first);
+        if (parts[token] & 2) append(pair.second);
+        spans[token] = {static_cast<uint32_t>(offset), static_cast<uint32_t>(arena.size() - offset)};
+    }
+    
+    arena_ = arena;
+    spans_ = spans;
+    return true;
+}
+
+} // namespace tknzr
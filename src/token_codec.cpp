@@ -0,0 +1,299 @@
+#include "tknzr/token_codec.hpp"
+#include "tknzr/simd.hpp"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TKNZR_X86_64 1
+#include <immintrin.h>
+#endif
+
+#if defined(TKNZR_X86_64) && defined(__GNUC__)
+#define TKNZR_TARGET_AVX2 __attribute__((target("avx2")))
+#define TKNZR_HAVE_AVX2 1
+#elif defined(TKNZR_X86_64) && defined(__AVX2__)
+#define TKNZR_TARGET_AVX2
+#define TKNZR_HAVE_AVX2 1
+#endif
+
+namespace tknzr {
+
+namespace {
+
+constexpr size_t kBlock = 128;
+constexpr size_t kLanes = 4;
+constexpr size_t kPerLane = kBlock / kLanes;
+
+// Block payload: `bits` words per lane, word k of all lanes stored together,
+// so a block of width b is b * 16 bytes
+constexpr size_t block_bytes(int bits) noexcept {
+    return static_cast<size_t>(bits) * kLanes * sizeof(uint32_t);
+}
+
+constexpr uint32_t low_mask(int bits) noexcept {
+    return bits >= 32 ? ~uint32_t{0} : (uint32_t{1} << bits) - 1;
+}
+
+void put_u32(std::string& out, uint32_t word) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(word >> (8 * i)));
+}
+
+uint32_t get_u32(const char* in) noexcept {
+    uint32_t word = 0;
+    for (int i = 0; i < 4; ++i) word |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return word;
+}
+
+// ============================================================================
+// Block unpacking
+// ============================================================================
+
+using UnpackBlock = void (*)(const char* in, int bits, uint32_t* out) noexcept;
+
+void unpack_scalar(const char* in, int bits, uint32_t* out) noexcept {
+    if (bits == 0) {
+        std::fill_n(out, kBlock, 0u);
+        return;
+    }
+    const uint32_t mask = low_mask(bits);
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        size_t offset = 0;
+        for (size_t v = 0; v < kPerLane; ++v, offset += bits) {
+            const size_t word = offset / 32;
+            const size_t shift = offset % 32;
+            uint64_t value = get_u32(in + (word * kLanes + lane) * 4) >> shift;
+            if (shift + bits > 32) {
+                value |= static_cast<uint64_t>(get_u32(in + ((word + 1) * kLanes + lane) * 4)) << (32 - shift);
+            }
+            out[v * kLanes + lane] = static_cast<uint32_t>(value) & mask;
+        }
+    }
+}
+
+#ifdef TKNZR_X86_64
+
+// Each step unpacks the next id of all four lanes, i.e. four consecutive ids
+void unpack_sse2(const char* in, int bits, uint32_t* out) noexcept {
+    if (bits == 0) {
+        std::fill_n(out, kBlock, 0u);
+        return;
+    }
+    const __m128i* words = reinterpret_cast<const __m128i*>(in);
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(low_mask(bits)));
+    size_t offset = 0;
+    for (size_t v = 0; v < kPerLane; ++v, offset += bits) {
+        const size_t word = offset / 32;
+        const int shift = static_cast<int>(offset % 32);
+        __m128i value = _mm_srl_epi32(_mm_loadu_si128(words + word), _mm_cvtsi32_si128(shift));
+        if (shift + bits > 32) {
+            value = _mm_or_si128(value, _mm_sll_epi32(_mm_loadu_si128(words + word + 1), _mm_cvtsi32_si128(32 - shift)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + v * kLanes), _mm_and_si128(value, mask));
+    }
+}
+
+#ifdef TKNZR_HAVE_AVX2
+
+// Two steps of unpack_sse2() at once with per-half shift counts. Variable
+// shifts by 32 give zero, and an id that ends in its first word only picks up
+// bits above the mask from the second, so no step needs a branch; the second
+// word is clamped to the block to stay in bounds.
+TKNZR_TARGET_AVX2
+void unpack_avx2(const char* in, int bits, uint32_t* out) noexcept {
+    if (bits == 0) {
+        std::fill_n(out, kBlock, 0u);
+        return;
+    }
+    const __m128i* words = reinterpret_cast<const __m128i*>(in);
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(low_mask(bits)));
+    const size_t last = static_cast<size_t>(bits) - 1;
+    auto load_pair = [&](size_t a, size_t b) TKNZR_TARGET_AVX2 {
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(words + a)),
+                                       _mm_loadu_si128(words + b), 1);
+    };
+    for (size_t v = 0; v < kPerLane; v += 2) {
+        const size_t first = v * bits;
+        const size_t second = first + bits;
+        const int s0 = static_cast<int>(first % 32);
+        const int s1 = static_cast<int>(second % 32);
+        const __m256i low = load_pair(first / 32, second / 32);
+        const __m256i high = load_pair(std::min(first / 32 + 1, last), std::min(second / 32 + 1, last));
+        const __m256i right = _mm256_setr_epi32(s0, s0, s0, s0, s1, s1, s1, s1);
+        const __m256i left = _mm256_sub_epi32(_mm256_set1_epi32(32), right);
+        const __m256i value = _mm256_or_si256(_mm256_srlv_epi32(low, right), _mm256_sllv_epi32(high, left));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + v * kLanes), _mm256_and_si256(value, mask));
+    }
+}
+
+#endif // TKNZR_HAVE_AVX2
+#endif // TKNZR_X86_64
+
+UnpackBlock select_unpack(SimdLevel level) noexcept {
+    switch (level) {
+#ifdef TKNZR_HAVE_AVX2
+        case SimdLevel::AVX2: return unpack_avx2;
+#endif
+#ifdef TKNZR_X86_64
+        case SimdLevel::SSE2: return unpack_sse2;
+#endif
+        default: return unpack_scalar;
+    }
+}
+
+// ============================================================================
+// Streams
+// ============================================================================
+
+template <typename T>
+void compress(std::span<const T> tokens, std::string& out) {
+    if constexpr (std::is_signed_v<T>) {
+        if (std::any_of(tokens.begin(), tokens.end(), [](T token) { return token < 0; })) {
+            throw std::invalid_argument("compress_tokens: negative token id");
+        }
+    }
+    
+    uint64_t count = tokens.size();
+    while (count >= 0x80) {
+        out.push_back(static_cast<char>(count | 0x80));
+        count >>= 7;
+    }
+    out.push_back(static_cast<char>(count));
+    
+    size_t pos = 0;
+    for (; pos + kBlock <= tokens.size(); pos += kBlock) {
+        const std::span<const T> block = tokens.subspan(pos, kBlock);
+        uint32_t high = 0;
+        for (T token : block) high |= static_cast<uint32_t>(token);
+        const int bits = std::bit_width(high);
+        out.push_back(static_cast<char>(bits));
+        if (bits == 0) continue;
+    
+        // 32 ids of `bits` bits fill exactly `bits` words per lane
+        uint32_t words[32][kLanes];
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            uint64_t pending = 0;
+            int filled = 0;
+            size_t word = 0;
+            for (size_t v = 0; v < kPerLane; ++v) {
+                pending |= static_cast<uint64_t>(static_cast<uint32_t>(block[v * kLanes + lane])) << filled;
+                filled += bits;
+                if (filled >= 32) {
+                    words[word++][lane] = static_cast<uint32_t>(pending);
+                    pending >>= 32;
+                    filled -= 32;
+                }
+            }
+        }
+        for (int k = 0; k < bits; ++k) {
+            for (size_t lane = 0; lane < kLanes; ++lane) put_u32(out, words[k][lane]);
+        }
+    }
+    
+    if (pos < tokens.size()) {
+        const std::span<const T> rest = tokens.subspan(pos);
+        uint32_t high = 0;
+        for (T token : rest) high |= static_cast<uint32_t>(token);
+        const int bits = std::bit_width(high);
+        out.push_back(static_cast<char>(bits));
+        uint64_t pending = 0;
+        int filled = 0;
+        for (T token : rest) {
+            pending |= static_cast<uint64_t>(static_cast<uint32_t>(token)) << filled;
+            filled += bits;
+            for (; filled >= 8; filled -= 8) {
+                out.push_back(static_cast<char>(pending));
+                pending >>= 8;
+            }
+        }
+        if (filled > 0) out.push_back(static_cast<char>(pending));
+    }
+}
+
+template <typename T>
+size_t decompress(std::string_view data, std::vector<T>& tokens) {
+    // Widest id the output type holds; Token ids are never negative
+    constexpr int kMaxBits = std::is_signed_v<T> ? 31 : static_cast<int>(8 * sizeof(T));
+    tokens.clear();
+    
+    size_t pos = 0;
+    uint64_t count = 0;
+    for (int shift = 0;; shift += 7) {
+        if (pos == data.size() || shift > 63) return 0;
+        const unsigned char byte = static_cast<unsigned char>(data[pos++]);
+        count |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    // Every block takes at least its width byte, which bounds a forged count
+    if (count > (data.size() - pos) * kBlock) return 0;
+    tokens.resize(count);
+    
+    const UnpackBlock unpack = select_unpack(simd_level());
+    uint32_t buffer[kBlock];
+    size_t done = 0;
+    auto fail = [&] {
+        tokens.clear();
+        return size_t{0};
+    };
+    for (; count - done >= kBlock; done += kBlock) {
+        if (pos == data.size()) return fail();
+        const int bits = static_cast<unsigned char>(data[pos++]);
+        if (bits > kMaxBits || data.size() - pos < block_bytes(bits)) return fail();
+        if constexpr (sizeof(T) == sizeof(uint32_t)) {
+            unpack(data.data() + pos, bits, reinterpret_cast<uint32_t*>(tokens.data() + done));
+        } else {
+            unpack(data.data() + pos, bits, buffer);
+            std::copy_n(buffer, kBlock, tokens.begin() + done);
+        }
+        pos += block_bytes(bits);
+    }
+    
+    if (done < count) {
+        if (pos == data.size()) return fail();
+        const int bits = static_cast<unsigned char>(data[pos++]);
+        const size_t bytes = ((count - done) * bits + 7) / 8;
+        if (bits > kMaxBits || data.size() - pos < bytes) return fail();
+        const uint32_t mask = low_mask(bits);
+        uint64_t pending = 0;
+        int filled = 0;
+        for (; done < count; ++done) {
+            while (filled < bits) {
+                pending |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos++])) << filled;
+                filled += 8;
+            }
+            tokens[done] = static_cast<T>(static_cast<uint32_t>(pending) & mask);
+            pending >>= bits;
+            filled -= bits;
+        }
+    }
+    return pos;
+}
+
+} // namespace
+
+void compress_tokens(std::span<const Token> tokens, std::string& out) {
+    compress(tokens, out);
+}
+
+void compress_tokens(std::span<const uint16_t> tokens, std::string& out) {
+    compress(tokens, out);
+}
+
+void compress_tokens(std::span<const uint32_t> tokens, std::string& out) {
+    compress(tokens, out);
+}
+
+size_t decompress_tokens(std::string_view data, std::vector<Token>& tokens) {
+    return decompress(data, tokens);
+}
+
+size_t decompress_tokens(std::string_view data, std::vector<uint16_t>& tokens) {
+    return decompress(data, tokens);
+}
+
+size_t decompress_tokens(std::string_view data, std::vector<uint32_t>& tokens) {
+    return decompress(data, tokens);
+}
+
+} // namespace tknzr
@@ -0,0 +1,257 @@
+#include "tknzr/trainer.hpp"
+#include "tknzr/mapped_file.hpp"
+#include "bpe_trainer.hpp"
+#include "piece_counter.hpp"
+#include "piece_table.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+
+namespace tknzr {
+
+// ============================================================================
+// Spill runs
+// ============================================================================
+//
+// A run is the in-memory piece table written out in byte order as records of
+//
+//   uint32_t length, uint64_t count, char piece[length]
+//
+// in native byte order. Runs only live for the lifetime of one Trainer.
+
+namespace {
+
+constexpr size_t kStreamBuffer = size_t{1} << 20;
+
+// Chunks counted between memory checks, per worker
+constexpr size_t kChunksPerCheck = 4;
+
+std::string unique_run_name(const void* owner) {
+    static std::atomic<uint64_t> next_run{0};
+    const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    return "tknzr-" + std::to_string(reinterpret_cast<uintptr_t>(owner)) + "-" +
+           std::to_string(now) + "-" + std::to_string(next_run.fetch_add(1)) + ".run";
+}
+
+class RunReader {
+public:
+    explicit RunReader(const std::string& path) : buffer_(kStreamBuffer) {
+        in_.rdbuf()->pubsetbuf(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        in_.open(path, std::ios::binary);
+        if (!in_) throw std::runtime_error("tknzr: cannot reopen spill file " + path);
+    }
+    
+    // Advance to the next record; false at the end of the run
+    bool next() {
+        uint32_t length = 0;
+        if (!in_.read(reinterpret_cast<char*>(&length), sizeof(length))) return false;
+        piece_.resize(length);
+        in_.read(reinterpret_cast<char*>(&count_), sizeof(count_));
+        in_.read(piece_.data(), length);
+        if (!in_) throw std::runtime_error("tknzr: truncated spill file");
+        return true;
+    }
+    
+    const std::string& piece() const noexcept { return piece_; }
+    uint64_t count() const noexcept { return count_; }
+
+private:
+    std::vector<char> buffer_;
+    std::ifstream in_;
+    std::string piece_;
+    uint64_t count_ = 0;
+};
+
+} // namespace
+
+Trainer::Trainer(SplitPattern pattern, size_t memory_limit)
+    : pattern_(pattern),
+      memory_limit_(memory_limit),
+      counter_(std::make_unique<PieceCounter>(pattern)) {}
+
+Trainer::~Trainer() {
+    finish_checkpoint();
+    remove_runs();
+}
+
+void Trainer::set_num_threads(size_t threads) {
+    if (threads == 0) {
+        pool_.reset();
+    } else {
+        pool_ = std::make_shared<ThreadPool>(threads);
+    }
+}
+
+ThreadPool& Trainer::thread_pool() const {
+    return pool_ ? *pool_ : ThreadPool::shared();
+}
+
+bool Trainer::add_file(const std::string& path) {
+    auto file = MappedFile::open(path);
+    if (!file) return false;
+    add_chunk(file->bytes());
+    return true;
+}
+
+void Trainer::add_chunk(std::string_view text) {
+    add_chunks(std::span(&text, 1));
+}
+
+void Trainer::add_chunks(std::span<const std::string_view> documents) {
+    if (resumed_) {
+        throw std::logic_error("tknzr: cannot add input to a trainer resumed from a checkpoint");
+    }
+    std::vector<std::string_view> chunks;
+    for (std::string_view document : documents) {
+        auto document_chunks = counter_->chunks(document);
+        chunks.insert(chunks.end(), document_chunks.begin(), document_chunks.end());
+    }
+    count_chunks(chunks);
+}
+
+void Trainer::count_chunks(const std::vector<std::string_view>& chunks) {
+    // Count a few chunks per worker at a time so the table can be spilled
+    // before it grows far past the limit
+    const size_t step = std::max<size_t>(thread_pool().size() * kChunksPerCheck, 1);
+    for (size_t begin = 0; begin < chunks.size(); begin += step) {
+        const size_t end = std::min(begin + step, chunks.size());
+        counter_->count(std::span(chunks).subspan(begin, end - begin), thread_pool());
+        if (counter_->memory_bytes() > memory_limit_) spill();
+    }
+}
+
+void Trainer::spill() {
+    if (counter_->unique_pieces() == 0) return;
+    
+    const std::filesystem::path directory = temp_directory_.empty()
+        ? std::filesystem::temp_directory_path() : std::filesystem::path(temp_directory_);
+    const std::string path = (directory / unique_run_name(this)).string();
+    
+    {
+        std::vector<char> buffer(kStreamBuffer);
+        std::ofstream out;
+        out.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("tknzr: cannot create spill file " + path);
+        runs_.push_back(path);
+    
+        for (const auto& [piece, count] : counter_->sorted()) {
+            const uint32_t length = static_cast<uint32_t>(piece.size());
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            out.write(piece.data(), static_cast<std::streamsize>(piece.size()));
+        }
+        out.flush();
+        if (!out) throw std::runtime_error("tknzr: cannot write spill file " + path);
+    }
+    counter_->clear();
+}
+
+void Trainer::remove_runs() {
+    for (const std::string& path : runs_) {
+        std::remove(path.c_str());
+    }
+    runs_.clear();
+}
+
+size_t Trainer::unique_pieces() const {
+    return counter_->unique_pieces();
+}
+
+std::shared_ptr<const PieceTable> Trainer::build_table() {
+    auto table = std::make_shared<PieceTable>();
+    if (runs_.empty()) {
+        for (const auto& [piece, count] : counter_->sorted()) {
+            table->add(piece, count);
+        }
+        return table;
+    }
+    
+    // k-way merge of the sorted runs, summing the counts of equal pieces
+    spill();
+    std::vector<std::unique_ptr<RunReader>> readers;
+    auto greater = [&](size_t a, size_t b) { return readers[a]->piece() > readers[b]->piece(); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (const std::string& path : runs_) {
+        readers.push_back(std::make_unique<RunReader>(path));
+        if (readers.back()->next()) heap.push(readers.size() - 1);
+    }
+    
+    std::string piece;
+    uint64_t count = 0;
+    while (!heap.empty()) {
+        const size_t run = heap.top();
+        heap.pop();
+        if (readers[run]->piece() != piece) {
+            table->add(piece, count);
+            piece = readers[run]->piece();
+            count = 0;
+        }
+        count += readers[run]->count();
+        if (readers[run]->next()) heap.push(run);
+    }
+    table->add(piece, count);
+    return table;
+}
+
+void Trainer::train(Tokenizer& tokenizer, int vocab_size) {
+    if (!resumed_) table_ = build_table();
+    
+    BpeTrainer trainer;
+    table_->for_each([&](std::string_view piece, uint64_t count) { trainer.add_word(piece, count); });
+    
+    // Replaying recorded merges rebuilds the exact state they left behind
+    const size_t target = vocab_size > 256 ? static_cast<size_t>(vocab_size) - 256 : 0;
+    for (size_t i = 0; i < resumed_merges_.size() && i < target; ++i) {
+        trainer.merge(resumed_merges_[i]);
+    }
+    
+    while (trainer.merges().size() < target && trainer.merge_next()) {
+        if (checkpoint_interval_ > 0 && trainer.merges().size() % checkpoint_interval_ == 0) {
+            checkpoint(trainer, false);
+        }
+    }
+    checkpoint(trainer, true);
+    
+    tokenizer.set_split_pattern(pattern_);
+    tokenizer.learn_merges(trainer, vocab_size);
+}
+
+void Trainer::set_checkpoint(const std::string& path, size_t interval) {
+    finish_checkpoint();
+    checkpoint_path_ = path;
+    checkpoint_interval_ = interval;
+}
+
+void Trainer::checkpoint(const BpeTrainer& trainer, bool final) {
+    if (checkpoint_path_.empty()) return;
+    
+    if (final) {
+        finish_checkpoint();
+        if (write_checkpoint(checkpoint_path_, *table_, trainer.merges(), pattern_)) checkpoints_written_++;
+        return;
+    }
+    if (pending_checkpoint_.valid() &&
+        pending_checkpoint_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return; // Still writing the previous one; try again at the next interval
+    }
+    finish_checkpoint();
+    
+    // Only the merge list is copied here; the piece table is shared read-only
+    pending_checkpoint_ = std::async(std::launch::async,
+        [path = checkpoint_path_, table = table_, merges = trainer.merges(), pattern = pattern_] {
+            return write_checkpoint(path, *table, merges, pattern);
+        });
+}
+
+void Trainer::finish_checkpoint() {
+    if (pending_checkpoint_.valid() && pending_checkpoint_.get()) checkpoints_written_++;
+}
+
+} // namespace tknzr
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace tknzr::unicode {
+
+    /**
+     * Character classes used by the pre-tokenizer split patterns
+     */
+    enum class CharClass : uint8_t {
+        Other,   // Punctuation, symbols, controls and invalid bytes
+        Letter,  // \p{L}
+        Number,  // \p{N}
+        Space,   // \s (Unicode White_Space)
+    };
+
+    struct DecodedChar {
+        uint32_t codepoint;
+        uint32_t length;  // Bytes consumed, at least 1
+        CharClass cls;
+    };
+
+    /**
+     * Classify a code point by General_Category / White_Space
+     */
+    CharClass classify(uint32_t codepoint) noexcept;
+
+    /**
+     * Classify an ASCII byte (must be < 0x80)
+     */
+    CharClass classify_ascii(unsigned char c) noexcept;
+
+    /**
+     * Decode and classify the UTF-8 character starting at text[pos]
+     * Invalid or truncated sequences decode as a single Other byte.
+     */
+    DecodedChar decode(std::string_view text, size_t pos) noexcept;
+
+    /**
+     * Length of a UTF-8 sequence cut off at the end of text, which more
+     * bytes could still complete (0 to 3)
+     */
+    size_t incomplete_suffix(std::string_view text) noexcept;
+
+}
@@ -0,0 +1,108 @@
+#include "tknzr/tknzr.hpp"
+#include "tknzr/stream.hpp"
+#include "counting_allocator.hpp"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Test that steady-state encode_into performs zero heap allocations
+TEST(AllocationTest, EncodeIntoIsAllocationFree) {
+    tknzr::Tokenizer tokenizer;
+    std::string corpus = "Steady state encoding should not touch the heap at all, 12345 times!";
+    tokenizer.train(corpus, 340);
+    std::vector<std::string> texts = {corpus, "short", "the heap at all", std::string(300, 'x')};
+    
+    std::vector<tknzr::Token> out(1024);
+    tknzr::EncodeScratch scratch;
+    auto run = [&] {
+        size_t total = 0;
+        for (const auto& text : texts) {
+            total += tokenizer.encode_into(text, out, scratch);
+        }
+        return total;
+    };
+    
+    // Sanity check that the counting allocator is live
+    const size_t baseline = allocations();
+    auto tokens = tokenizer.encode(corpus);
+    EXPECT_GT(allocations(), baseline);
+    
+    // Over-aligned and nothrow allocations are counted as well
+    struct alignas(64) Line { char bytes[64]; };
+    const size_t plain = allocations();
+    auto line = std::make_unique<Line>();
+    std::unique_ptr<int> nothrow(new (std::nothrow) int(1));
+    EXPECT_EQ(allocations() - plain, 2u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(line.get()) % 64, 0u);
+    
+    const size_t expected = run(); // Warm-up grows the scratch buffers
+    const size_t before = allocations();
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(run(), expected);
+    }
+    EXPECT_EQ(allocations() - before, 0u);
+    
+    // A warm cache serves every piece without allocating either
+    tokenizer.enable_cache(1 << 20);
+    run();
+    const size_t cached_before = allocations();
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(run(), expected);
+    }
+    EXPECT_EQ(allocations() - cached_before, 0u);
+}
+
+// Test that a short buffer reports the size it needs
+TEST(AllocationTest, EncodeIntoReportsRequiredSize) {
+    tknzr::Tokenizer tokenizer;
+    std::string text = "The quick brown fox jumps over the lazy dog";
+    tokenizer.train(text, 300);
+    auto expected = tokenizer.encode(text);
+    
+    tknzr::EncodeScratch scratch;
+    std::vector<tknzr::Token> small(3);
+    EXPECT_EQ(tokenizer.encode_into(text, small, scratch), expected.size());
+    EXPECT_TRUE(std::equal(small.begin(), small.end(), expected.begin()));
+    
+    std::vector<tknzr::Token> exact(expected.size());
+    EXPECT_EQ(tokenizer.encode_into(text, exact, scratch), expected.size());
+    EXPECT_EQ(exact, expected);
+    EXPECT_EQ(tokenizer.encode_into("", exact, scratch), 0u);
+}
+
+// Test that streaming decode allocates nothing once the output has capacity
+TEST(AllocationTest, StreamDecoderSteadyStateIsAllocationFree) {
+    tknzr::Tokenizer tokenizer;
+    std::string text = "caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac and more caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac";
+    tokenizer.train(text, 300);
+    const auto tokens = tokenizer.encode(text);
+    
+    tknzr::StreamDecoder decoder(tokenizer);
+    std::string out;
+    out.reserve(4 * text.size());
+    const size_t before = allocations();
+    for (int i = 0; i < 3; ++i) {
+        for (tknzr::Token token : tokens) decoder.write(token, out);
+    }
+    decoder.finish(out);
+    EXPECT_EQ(allocations() - before, 0u);
+    EXPECT_EQ(out, text + text + text);
+}
+
+// Test that counting tokens allocates nothing once the scratch is warm
+TEST(AllocationTest, CountTokensIsAllocationFree) {
+    tknzr::Tokenizer tokenizer;
+    std::string text = "The quick brown fox jumps over the lazy dog. The lazy dog sleeps.";
+    tokenizer.train(text, 320);
+    
+    const size_t expected = tokenizer.encode(text).size();
+    EXPECT_EQ(tokenizer.count_tokens(text), expected);  // Warm-up
+    const size_t before = allocations();
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(tokenizer.count_tokens(text), expected);
+    }
+    EXPECT_EQ(allocations() - before, 0u);
+}
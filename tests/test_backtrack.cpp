@@ -0,0 +1,75 @@
+#include "tknzr/tknzr.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string random_text(std::mt19937& rng, const std::string& alphabet, size_t len) {
+    std::string text;
+    for (size_t i = 0; i < len; ++i) text += alphabet[rng() % alphabet.size()];
+    return text;
+}
+
+// Encodes with both engines and expects identical tokens
+static void expect_same_encoding(const tknzr::Tokenizer& heap, const std::string& text) {
+    tknzr::Tokenizer backtracking = heap;
+    backtracking.set_bpe_algorithm(tknzr::BpeAlgorithm::Backtracking);
+    ASSERT_EQ(backtracking.bpe_algorithm(), tknzr::BpeAlgorithm::Backtracking);
+    EXPECT_EQ(backtracking.encode(text), heap.encode(text)) << text;
+}
+
+// Test that the backtracking engine matches rank-ordered merging on random
+// vocabularies and inputs
+TEST(BacktrackTest, FuzzMatchesHeapEngine) {
+    std::mt19937 rng(2024);
+    for (const std::string alphabet : {"ab", "abc", "aab c\n", "xyz xyz\t01"}) {
+        for (int round = 0; round < 15; ++round) {
+            tknzr::Tokenizer heap;
+            heap.set_split_pattern(tknzr::SplitPattern::None);
+            heap.train(random_text(rng, alphabet, 50 + rng() % 600), 256 + 10 + rng() % 120);
+    
+            tknzr::Tokenizer backtracking = heap;
+            backtracking.set_bpe_algorithm(tknzr::BpeAlgorithm::Backtracking);
+            ASSERT_EQ(backtracking.bpe_algorithm(), tknzr::BpeAlgorithm::Backtracking);
+            for (int i = 0; i < 40; ++i) {
+                const std::string text = random_text(rng, alphabet, 1 + rng() % 200);
+                EXPECT_EQ(backtracking.encode(text), heap.encode(text)) << text;
+            }
+        }
+    }
+}
+
+// Test the inputs the engine exists for: long runs and repetitive blobs
+TEST(BacktrackTest, PathologicalInputs) {
+    tknzr::Tokenizer heap;
+    heap.set_split_pattern(tknzr::SplitPattern::None);
+    heap.train(std::string(3000, 'a') + std::string(500, 'b') + "abababab", 400);
+    for (size_t len : {1u, 2u, 3u, 63u, 64u, 65u, 1000u, 4097u}) {
+        expect_same_encoding(heap, std::string(len, 'a'));
+        expect_same_encoding(heap, std::string(len, 'b') + std::string(len, 'a'));
+    }
+    
+    std::string blob;
+    for (int i = 0; i < 2000; ++i) blob += "QUJDRA=="[i % 8];
+    tknzr::Tokenizer pieces;
+    const std::vector<std::string_view> corpus = {blob, "function(a){return a+1};var b=function(c){return c};"};
+    pieces.train_pieces(corpus, 600);
+    expect_same_encoding(pieces, blob);
+    expect_same_encoding(pieces, "var x=function(y){return y+1};" + blob.substr(0, 333));
+}
+
+// Test that vocabularies the engine cannot handle fall back to the heap
+TEST(BacktrackTest, FallsBackOnForwardReferences) {
+    tknzr::Tokenizer tokenizer;
+    // Token 256 merges (256, 257), which refers to itself and a later token
+    ASSERT_TRUE(tokenizer.load_from_tiktoken_binary({0, 1, 1, 1, 'a', 0, 'b', 0}));
+    tokenizer.set_bpe_algorithm(tknzr::BpeAlgorithm::Backtracking);
+    EXPECT_EQ(tokenizer.bpe_algorithm(), tknzr::BpeAlgorithm::Heap);
+    EXPECT_EQ(tokenizer.decode(tokenizer.encode("ab")), "ab");
+    
+    // A new vocabulary rebuilds the requested engine
+    tokenizer.train("abababab", 260);
+    EXPECT_EQ(tokenizer.bpe_algorithm(), tknzr::BpeAlgorithm::Backtracking);
+    tokenizer.set_bpe_algorithm(tknzr::BpeAlgorithm::Heap);
+    EXPECT_EQ(tokenizer.bpe_algorithm(), tknzr::BpeAlgorithm::Heap);
+}
@@ -0,0 +1,144 @@
+#include "tknzr/tknzr.hpp"
+#include <gtest/gtest.h>
+#include <climits>
+#include <random>
+#include <string>
+#include <vector>
+
+using tknzr::SimdLevel;
+
+// Random ids below 2^bits, with the top id present so the width is exact
+static std::vector<uint32_t> random_ids(std::mt19937& rng, int bits, size_t count) {
+    std::vector<uint32_t> ids(count);
+    const uint32_t mask = bits >= 32 ? ~0u : (1u << bits) - 1;
+    for (uint32_t& id : ids) id = rng() & mask;
+    if (count > 0) ids[count / 2] = mask;
+    return ids;
+}
+
+// Test round trips at every id width and around the block size
+TEST(CodecTest, RoundTripsEveryWidth) {
+    std::mt19937 rng(25);
+    for (int bits = 0; bits <= 31; ++bits) {
+        for (size_t count : {0u, 1u, 127u, 128u, 129u, 1000u}) {
+            const std::vector<uint32_t> ids = random_ids(rng, bits, count);
+            const tknzr::TokenList tokens(ids.begin(), ids.end());
+            std::string data = "prefix";
+            tknzr::compress_tokens(tokens, data);
+            data += "trailing";
+    
+            tknzr::TokenList decoded;
+            const size_t used = tknzr::decompress_tokens(std::string_view(data).substr(6), decoded);
+            ASSERT_EQ(used, data.size() - 6 - 8) << bits << " " << count;
+            EXPECT_EQ(decoded, tokens) << bits << " " << count;
+    
+            std::vector<uint32_t> wide;
+            EXPECT_EQ(tknzr::decompress_tokens(std::string_view(data).substr(6), wide), used);
+            EXPECT_EQ(wide, ids);
+    
+            std::vector<uint16_t> narrow;
+            const size_t narrow_used = tknzr::decompress_tokens(std::string_view(data).substr(6), narrow);
+            if (bits <= 16) {
+                EXPECT_EQ(narrow_used, used);
+                EXPECT_EQ(std::vector<uint32_t>(narrow.begin(), narrow.end()), ids);
+            } else if (count > 0) {
+                EXPECT_EQ(narrow_used, 0u);
+                EXPECT_TRUE(narrow.empty());
+            }
+        }
+    }
+    
+    // Ids at the edges of real vocabularies, mixed into one block
+    const tknzr::TokenList edges = {0, 255, 256, 50256, 65535, 65536, 100255, 100276, 199999, INT_MAX};
+    std::string data;
+    tknzr::compress_tokens(edges, data);
+    tknzr::TokenList decoded;
+    EXPECT_EQ(tknzr::decompress_tokens(data, decoded), data.size());
+    EXPECT_EQ(decoded, edges);
+    
+    // 32-bit ids only decode to uint32_t
+    const std::vector<uint32_t> full(200, 0xFFFFFFFFu);
+    data.clear();
+    tknzr::compress_tokens(full, data);
+    std::vector<uint32_t> wide;
+    EXPECT_EQ(tknzr::decompress_tokens(data, wide), data.size());
+    EXPECT_EQ(wide, full);
+    EXPECT_EQ(tknzr::decompress_tokens(data, decoded), 0u);
+    
+    EXPECT_THROW(tknzr::compress_tokens(tknzr::TokenList{1, -1}, data), std::invalid_argument);
+}
+
+// Test that the output is a fraction of the raw ids
+TEST(CodecTest, PacksToIdWidth) {
+    std::mt19937 rng(1);
+    const std::vector<uint32_t> ids = random_ids(rng, 17, 128 * 100);
+    std::string data;
+    tknzr::compress_tokens(ids, data);
+    EXPECT_LE(data.size(), ids.size() * 17 / 8 + 100 + 2);
+}
+
+// Test that cut or forged streams are rejected instead of over-read
+TEST(CodecTest, RejectsMalformedStreams) {
+    std::mt19937 rng(7);
+    const std::vector<uint32_t> ids = random_ids(rng, 13, 300);
+    std::string data;
+    tknzr::compress_tokens(ids, data);
+    std::vector<uint32_t> decoded;
+    for (size_t cut = 0; cut < data.size(); ++cut) {
+        EXPECT_EQ(tknzr::decompress_tokens(std::string_view(data).substr(0, cut), decoded), 0u) << cut;
+        EXPECT_TRUE(decoded.empty());
+    }
+    
+    // A huge count with too few bytes behind it
+    EXPECT_EQ(tknzr::decompress_tokens(std::string("\xFF\xFF\xFF\xFF\x0F\x00", 6), decoded), 0u);
+    // A block width above 32
+    EXPECT_EQ(tknzr::decompress_tokens(std::string("\x01\x21\x00\x00\x00\x00\x00", 7), decoded), 0u);
+}
+
+// Test that every SIMD level decodes the same ids
+TEST(CodecTest, SimdLevelsAgree) {
+    std::mt19937 rng(11);
+    const SimdLevel saved = tknzr::simd_level();
+    for (int bits = 0; bits <= 32; ++bits) {
+        const std::vector<uint32_t> ids = random_ids(rng, bits, 128 * 3 + 5);
+        std::string data;
+        tknzr::compress_tokens(ids, data);
+        for (auto level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+            if (tknzr::set_simd_level(level) != level) continue;
+            std::vector<uint32_t> decoded;
+            EXPECT_EQ(tknzr::decompress_tokens(data, decoded), data.size());
+            EXPECT_EQ(decoded, ids) << bits;
+        }
+    }
+    tknzr::set_simd_level(saved);
+}
+
+// Test the narrow token outputs against encode() and decode()
+TEST(CodecTest, CompactEncodeMatchesEncode) {
+    tknzr::Tokenizer tokenizer;
+    const std::string text = "the quick brown fox jumps over the lazy dog, then the fox sleeps. ";
+    tokenizer.train(text + text + text, 300);
+    EXPECT_EQ(tokenizer.token_width(), 2u);
+    
+    const std::string sample = "the lazy fox jumps, the dog sleeps";
+    const tknzr::TokenList tokens = tokenizer.encode(sample);
+    std::vector<uint16_t> narrow;
+    std::vector<uint32_t> wide;
+    tokenizer.encode_compact(sample, narrow);
+    tokenizer.encode_compact(sample, wide);
+    EXPECT_EQ(tknzr::TokenList(narrow.begin(), narrow.end()), tokens);
+    EXPECT_EQ(tknzr::TokenList(wide.begin(), wide.end()), tokens);
+    
+    std::string decoded;
+    tokenizer.decode_into(std::span<const uint16_t>(narrow), decoded);
+    EXPECT_EQ(decoded, sample);
+    tokenizer.decode_into(std::span<const uint32_t>(wide), decoded);
+    EXPECT_EQ(decoded, sample);
+    
+    // A special token past 16 bits widens the output
+    tokenizer.add_special_token("<|end|>", 70000);
+    EXPECT_EQ(tokenizer.token_width(), 4u);
+    EXPECT_THROW(tokenizer.encode_compact(sample, narrow), std::length_error);
+    tokenizer.encode_compact(sample, wide);
+    EXPECT_EQ(tknzr::TokenList(wide.begin(), wide.end()), tokens);
+}
@@ -0,0 +1,174 @@
+#include "encode_job.hpp"
+#include "tknzr/tknzr.hpp"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace tknzr::encode_job;
+
+static fs::path fresh_dir(const std::string& name) {
+    const fs::path dir = fs::temp_directory_path() / name;
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    return dir;
+}
+
+static void write_file(const fs::path& path, const std::string& text) {
+    std::ofstream(path, std::ios::binary) << text;
+}
+
+static std::string read_file(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+// Everything the job wrote, by file name
+static std::map<std::string, std::string> read_outputs(const fs::path& dir) {
+    std::map<std::string, std::string> outputs;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        outputs[entry.path().filename().string()] = read_file(entry.path());
+    }
+    return outputs;
+}
+
+// The loop of tknzr-encode's run(), without the pipelining; returns the
+// number of shards it resumed after and collects the shards it finished
+static size_t run_job(const Options& options, const tknzr::Tokenizer& tokenizer, const std::vector<std::string>& files,
+                      std::vector<ShardStats>* finished = nullptr) {
+    const std::string fingerprint = job_fingerprint(files, options, tokenizer, 2);
+    auto [cursor, shards] = open_manifest(options.out, fingerprint, 2);
+    ShardWriter writer(options, 2, shards, [&](const ShardStats& shard) {
+        if (finished) finished->push_back(shard);
+    });
+    while (cursor.file < files.size()) {
+        const Batch batch = next_batch(files, cursor, options);
+        writer.append(tokenizer.encode_batch(batch.documents), batch.end);
+    }
+    writer.finish(cursor);
+    return shards;
+}
+
+// Test document splitting across files, empty files and trailing separators
+TEST(EncodeJobTest, SplitsDocumentsAtSeparators) {
+    const fs::path dir = fresh_dir("tknzr_encode_split");
+    write_file(dir / "a.txt", "one||two||");
+    write_file(dir / "b.txt", "");
+    write_file(dir / "c.txt", "||three");
+    const std::vector<std::string> files = list_inputs({dir.string()});
+    ASSERT_EQ(files.size(), 3u);
+    
+    Options options;
+    options.separator = "||";
+    options.batch_bytes = 3;
+    std::vector<std::string> documents;
+    std::vector<size_t> batch_sizes;
+    Cursor cursor;
+    while (cursor.file < files.size()) {
+        const Batch batch = next_batch(files, cursor, options);
+        batch_sizes.push_back(batch.documents.size());
+        documents.insert(documents.end(), batch.documents.begin(), batch.documents.end());
+        EXPECT_EQ(batch.end.file, cursor.file);
+        EXPECT_EQ(batch.end.offset, cursor.offset);
+    }
+    EXPECT_EQ(documents, (std::vector<std::string>{"one", "two", "", "", "three"}));
+    EXPECT_EQ(batch_sizes, (std::vector<size_t>{1, 1, 3}));
+    
+    // Without a separator each file is one document
+    options.separator.clear();
+    options.batch_bytes = 1 << 20;
+    cursor = Cursor{};
+    const Batch whole = next_batch(files, cursor, options);
+    EXPECT_EQ(std::vector<std::string>(whole.documents.begin(), whole.documents.end()),
+              (std::vector<std::string>{"one||two||", "", "||three"}));
+    fs::remove_all(dir);
+}
+
+// Test that the fingerprint changes with the vocabulary, not just its size
+TEST(EncodeJobTest, FingerprintCoversVocabulary) {
+    const fs::path dir = fresh_dir("tknzr_encode_fingerprint");
+    write_file(dir / "input.txt", "text");
+    const std::vector<std::string> files = {(dir / "input.txt").string()};
+    const Options options;
+    
+    tknzr::Tokenizer first;
+    tknzr::Tokenizer second;
+    first.train("the cat sat on the mat with the hat", 270);
+    second.train("a dog dug a log in a bog all day long", 270);
+    ASSERT_EQ(first.vocab_size(), second.vocab_size());
+    const std::string fingerprint = job_fingerprint(files, options, first, 2);
+    EXPECT_EQ(job_fingerprint(files, options, first, 2), fingerprint);
+    EXPECT_NE(job_fingerprint(files, options, second, 2), fingerprint);
+    EXPECT_NE(job_fingerprint(files, options, first, 4), fingerprint);
+    
+    first.add_special_token("<|end|>", 300);
+    EXPECT_NE(job_fingerprint(files, options, first, 2), fingerprint);
+    fs::remove_all(dir);
+}
+
+// Test that a manifest cut off mid-line resumes after its last whole shard
+// and ends up with the same output as an uninterrupted run
+TEST(EncodeJobTest, ResumesAfterTruncatedManifest) {
+    const fs::path input = fresh_dir("tknzr_encode_input");
+    std::string text;
+    for (int i = 0; i < 40; ++i) text += "document " + std::to_string(i) + " about the cat and the mat\n";
+    write_file(input / "part1.txt", text);
+    write_file(input / "part2.txt", text + text);
+    const std::vector<std::string> files = list_inputs({input.string()});
+    
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train(text, 300);
+    Options options;
+    options.separator = "\n";
+    options.shard_bytes = 200;
+    options.batch_bytes = 100;
+    
+    options.out = fresh_dir("tknzr_encode_full").string();
+    EXPECT_EQ(run_job(options, tokenizer, files), 0u);
+    const std::map<std::string, std::string> expected = read_outputs(options.out);
+    ASSERT_GT(expected.size(), 8u);
+    
+    // Copy the first shards, then cut the manifest inside a later line
+    options.out = fresh_dir("tknzr_encode_resumed").string();
+    const std::string manifest = expected.at("manifest.txt");
+    size_t cut = 0;
+    for (int line = 0; line < 4; ++line) cut = manifest.find('\n', cut) + 1;
+    cut += 10;
+    write_file(fs::path(options.out) / "manifest.txt", manifest.substr(0, cut));
+    for (const auto& [name, bytes] : expected) {
+        if (name.rfind("shard-00000", 0) == 0 || name.rfind("shard-00001", 0) == 0 ||
+            name.rfind("shard-00002", 0) == 0) {
+            write_file(fs::path(options.out) / name, bytes);
+        }
+    }
+    // A leftover partial shard is redone
+    write_file(fs::path(options.out) / "shard-00003.tokens.tmp", "junk");
+    
+    std::vector<ShardStats> finished;
+    EXPECT_EQ(run_job(options, tokenizer, files, &finished), 3u);
+    ASSERT_EQ(finished.size(), (expected.size() - 1) / 2 - 3);
+    EXPECT_EQ(finished.front().index, 3u);
+    EXPECT_GT(finished.front().tokens, 0u);
+    std::map<std::string, std::string> resumed = read_outputs(options.out);
+    resumed.erase("shard-00003.tokens.tmp");
+    EXPECT_EQ(resumed, expected);
+    
+    // Resuming a finished job writes nothing more
+    finished.clear();
+    EXPECT_EQ(run_job(options, tokenizer, files, &finished), (expected.size() - 1) / 2);
+    EXPECT_TRUE(finished.empty());
+    EXPECT_EQ(read_file(fs::path(options.out) / "manifest.txt"), manifest);
+    
+    // A different tokenizer is refused
+    tknzr::Tokenizer other;
+    other.train("something else entirely", 300);
+    EXPECT_THROW(run_job(options, other, files), std::runtime_error);
+    
+    fs::remove_all(input);
+    fs::remove_all(options.out);
+    fs::remove_all(fs::temp_directory_path() / "tknzr_encode_full");
+}
@@ -0,0 +1,70 @@
+#include "tknzr/tknzr.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using tknzr::Counter;
+using tknzr::Stage;
+
+// Test that counters account for every piece, token and decoded byte
+TEST(MetricsTest, CountsEncodeAndDecode) {
+    tknzr::Tokenizer tokenizer;
+    const std::string text = "metrics count pieces, merges and tokens: metrics count everything";
+    tokenizer.train(text, 300);
+    
+    tknzr::reset_metrics();
+    const tknzr::TokenList tokens = tokenizer.encode(text);
+    const std::string decoded = tokenizer.decode(tokens);
+    const tknzr::MetricsSnapshot snapshot = tknzr::metrics_snapshot();
+    if (!tknzr::metrics_enabled()) {
+        EXPECT_EQ(snapshot[Counter::EncodeCalls], 0u);
+        EXPECT_EQ(snapshot[Stage::Encode].count, 0u);
+        return;
+    }
+    
+    const size_t pieces = tknzr::PreTokenizer(tokenizer.split_pattern()).split(text).size();
+    EXPECT_EQ(snapshot[Counter::EncodeCalls], 1u);
+    EXPECT_EQ(snapshot[Counter::Pieces], pieces);
+    EXPECT_EQ(snapshot[Counter::BytesIn], text.size());
+    EXPECT_EQ(snapshot[Counter::TokensOut], tokens.size());
+    EXPECT_EQ(snapshot[Counter::Merges], text.size() - tokens.size());
+    EXPECT_EQ(snapshot[Counter::DecodeCalls], 1u);
+    EXPECT_EQ(snapshot[Counter::DecodeTokens], tokens.size());
+    EXPECT_EQ(snapshot[Counter::BytesOut], decoded.size());
+    EXPECT_EQ(snapshot[Stage::Encode].count, 1u);
+    EXPECT_LE(snapshot[Stage::Merge].count, pieces / 16 + 1);  // Per-piece stages are sampled
+    EXPECT_LE(snapshot[Stage::Pretokenize].count, pieces / 16 + 1);
+    EXPECT_GE(snapshot[Stage::Encode].percentile_ns(1.0), snapshot[Stage::Encode].percentile_ns(0.5));
+}
+
+// Test the cache hit rate and that threads' shards are all summed
+TEST(MetricsTest, CacheHitsAcrossThreads) {
+    tknzr::Tokenizer tokenizer;
+    const std::string text = "the same words again and again and again";
+    tokenizer.train(text, 290);
+    tokenizer.enable_cache();
+    tokenizer.encode(text);  // Fill the cache
+    
+    tknzr::reset_metrics();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 50; ++i) tokenizer.encode(text);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    
+    const tknzr::MetricsSnapshot snapshot = tknzr::metrics_snapshot();
+    if (!tknzr::metrics_enabled()) {
+        EXPECT_EQ(snapshot.cache_hit_rate(), 0.0);
+        return;
+    }
+    EXPECT_EQ(snapshot[Counter::EncodeCalls], 200u);
+    EXPECT_EQ(snapshot[Counter::BytesIn], 200 * text.size());
+    EXPECT_EQ(snapshot[Counter::CacheMisses], 0u);
+    EXPECT_DOUBLE_EQ(snapshot.cache_hit_rate(), 1.0);
+    EXPECT_EQ(snapshot[Counter::Merges], 0u);
+    EXPECT_GT(snapshot[Stage::CacheLookup].count, 0u);
+    EXPECT_EQ(snapshot[Stage::Merge].count, 0u);
+}
@@ -0,0 +1,141 @@
+#include "tknzr/tknzr.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Pieces = std::vector<std::string_view>;
+
+static Pieces split(tknzr::SplitPattern pattern, std::string_view text) {
+    return tknzr::PreTokenizer(pattern).split(text);
+}
+
+// Test cl100k_base splits (expected pieces match tiktoken's regex)
+TEST(PreTokenizerTest, CL100KPattern) {
+    using tknzr::SplitPattern;
+    EXPECT_EQ(split(SplitPattern::CL100K, "Hello, world! I'm fine."),
+              (Pieces{"Hello", ",", " world", "!", " I", "'m", " fine", "."}));
+    EXPECT_EQ(split(SplitPattern::CL100K, "1234567 apples"), (Pieces{"123", "456", "7", " apples"}));
+    EXPECT_EQ(split(SplitPattern::CL100K, "a   b"), (Pieces{"a", "  ", " b"}));
+    EXPECT_EQ(split(SplitPattern::CL100K, "x\n\n  y"), (Pieces{"x", "\n\n", " ", " y"}));
+    EXPECT_EQ(split(SplitPattern::CL100K, "don'T 'LL"), (Pieces{"don", "'T", " '", "LL"}));
+    EXPECT_EQ(split(SplitPattern::CL100K, "  \tfoo\r\n"), (Pieces{"  ", "\tfoo", "\r\n"}));
+    EXPECT_EQ(split(SplitPattern::CL100K, "你好世界 123"), (Pieces{"你好世界", " ", "123"}));
+}
+
+// Test GPT-2 splits
+TEST(PreTokenizerTest, GPT2Pattern) {
+    using tknzr::SplitPattern;
+    EXPECT_EQ(split(SplitPattern::GPT2, "1234567 apples"), (Pieces{"1234567", " apples"}));
+    EXPECT_EQ(split(SplitPattern::GPT2, "x\n\n  y"), (Pieces{"x", "\n\n ", " y"}));
+    EXPECT_EQ(split(SplitPattern::GPT2, "don'T 'LL"), (Pieces{"don", "'", "T", " '", "LL"}));
+    EXPECT_EQ(split(SplitPattern::GPT2, "  \tfoo\r\n"), (Pieces{"  ", "\t", "foo", "\r\n"}));
+    EXPECT_EQ(split(SplitPattern::GPT2, "你好世界 123"), (Pieces{"你好世界", " 123"}));
+}
+
+// Test that no pattern keeps the input whole and invalid UTF-8 is still covered
+TEST(PreTokenizerTest, NoneAndInvalidUtf8) {
+    using tknzr::SplitPattern;
+    EXPECT_EQ(split(SplitPattern::None, "a b c"), (Pieces{"a b c"}));
+    EXPECT_TRUE(split(SplitPattern::CL100K, "").empty());
+    
+    const std::string invalid = "ab\xff\xfe cd\xe4\xb8";
+    for (auto pattern : {SplitPattern::GPT2, SplitPattern::CL100K}) {
+        std::string joined;
+        for (auto piece : split(pattern, invalid)) {
+            EXPECT_FALSE(piece.empty());
+            joined += piece;
+        }
+        EXPECT_EQ(joined, invalid);
+    }
+}
+
+// Test that encode runs BPE per piece and never merges across pieces
+TEST(PreTokenizerTest, EncodeRespectsPieces) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.set_split_pattern(tknzr::SplitPattern::None);
+    std::string text = "ab ab ab ab";
+    tokenizer.train(text, 270);
+    EXPECT_EQ(tokenizer.encode(text).size(), 1u);
+    
+    tokenizer.set_split_pattern(tknzr::SplitPattern::CL100K);
+    EXPECT_EQ(tokenizer.split_pattern(), tknzr::SplitPattern::CL100K);
+    auto tokens = tokenizer.encode(text);
+    EXPECT_EQ(tokens.size(), 4u); // "ab", " ab", " ab", " ab"
+    EXPECT_EQ(tokenizer.decode(tokens), text);
+}
+
+// Random text built from runs of one class so vector blocks see long runs,
+// class changes at every offset, and multi-byte characters inside runs
+static std::string random_runs(std::mt19937& rng, size_t runs) {
+    static const std::vector<std::string> alphabet[] = {
+        {"a", "Z", "q", "\xc3\xa9", "\xce\xbb", "\xe4\xbd\xa0"},
+        {"0", "7", "9", "\xd9\xa3"},
+        {" ", "\t", "\n", "\r", "\x0b", "\xc2\xa0", "\xe3\x80\x80"},
+        {".", "'", "{", "@", "\x01", "\x7f", "\xe2\x80\x94", "\xff", "\xe4\xb8"},
+    };
+    std::string text;
+    for (size_t r = 0; r < runs; ++r) {
+        const auto& chars = alphabet[rng() % 4];
+        const size_t length = rng() % 4 == 0 ? rng() % 80 : rng() % 6;
+        for (size_t i = 0; i <= length; ++i) text += chars[rng() % chars.size()];
+    }
+    return text;
+}
+
+static std::string read_source(const char* relative) {
+    std::ifstream in(std::string(TKNZR_SOURCE_DIR) + "/" + relative, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+// Test that every vectorized scan level splits exactly like the scalar one
+TEST(PreTokenizerTest, SimdLevelsMatchScalar) {
+    using tknzr::SimdLevel;
+    using tknzr::SplitPattern;
+    std::mt19937 rng(18);
+    std::vector<std::string> corpora = {read_source("README.md"), read_source("src/pretokenizer.cpp"),
+                                        read_source("src/unicode.cpp")};
+    for (int i = 0; i < 200; ++i) corpora.push_back(random_runs(rng, 1 + rng() % 60));
+    
+    const SimdLevel saved = tknzr::simd_level();
+    for (auto pattern : {SplitPattern::GPT2, SplitPattern::CL100K}) {
+        for (const std::string& text : corpora) {
+            tknzr::set_simd_level(SimdLevel::Scalar);
+            const Pieces expected = split(pattern, text);
+            for (auto level : {SimdLevel::SSE2, SimdLevel::AVX2}) {
+                if (tknzr::set_simd_level(level) != level) continue;
+                EXPECT_EQ(split(pattern, text), expected);
+            }
+        }
+    }
+    tknzr::set_simd_level(saved);
+    EXPECT_FALSE(corpora[0].empty());
+}
+
+// Test that boundary_after only reports positions where split() starts a piece
+TEST(PreTokenizerTest, BoundaryAfterIsAPieceStart) {
+    std::mt19937 rng(23);
+    for (auto pattern : {tknzr::SplitPattern::GPT2, tknzr::SplitPattern::CL100K}) {
+        const tknzr::PreTokenizer pretokenizer(pattern);
+        for (int i = 0; i < 200; ++i) {
+            const std::string text = random_runs(rng, 1 + rng() % 60);
+            std::vector<size_t> starts;
+            for (std::string_view piece : split(pattern, text)) starts.push_back(piece.data() - text.data());
+            for (size_t pos = 0; pos < text.size();) {
+                pos = pretokenizer.boundary_after(text, pos);
+                if (pos == text.size()) break;
+                EXPECT_TRUE(std::binary_search(starts.begin(), starts.end(), pos)) << pos;
+                ++pos;
+            }
+        }
+    }
+    EXPECT_EQ(tknzr::PreTokenizer(tknzr::SplitPattern::None).boundary_after("ab cd", 0), 5u);
+    EXPECT_EQ(tknzr::PreTokenizer().boundary_after("ab cd", 0), 2u);
+    EXPECT_EQ(tknzr::PreTokenizer().boundary_after("ab cd", 3), 5u);
+}
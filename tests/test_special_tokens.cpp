@@ -0,0 +1,133 @@
+#include "tknzr/tknzr.hpp"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <algorithm>
+#include <climits>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Reference: try every start position and every pattern
+static std::optional<tknzr::SpecialTokens::Match> naive_find(
+        const std::vector<std::string>& patterns, std::string_view text, size_t from) {
+    for (size_t begin = from; begin < text.size(); ++begin) {
+        std::optional<tknzr::SpecialTokens::Match> best;
+        for (size_t p = 0; p < patterns.size(); ++p) {
+            if (text.substr(begin).starts_with(patterns[p]) && (!best || patterns[p].size() > best->length)) {
+                best = tknzr::SpecialTokens::Match{begin, patterns[p].size(), static_cast<tknzr::Token>(1000 + p)};
+            }
+        }
+        if (best) return best;
+    }
+    return std::nullopt;
+}
+
+// Test the automaton against the reference on overlapping patterns
+TEST(SpecialTokensTest, FindsLeftmostLongest) {
+    const std::vector<std::string> patterns = {"<|a|>", "|a", "a|>", "<|", "<|ab|>", "b", "<|a|>x"};
+    tknzr::SpecialTokens specials;
+    for (size_t p = 0; p < patterns.size(); ++p) {
+        ASSERT_TRUE(specials.add(patterns[p], static_cast<tknzr::Token>(1000 + p)));
+    }
+    EXPECT_FALSE(specials.add("b", 2000));
+    EXPECT_FALSE(specials.add("c", 1000));
+    EXPECT_FALSE(specials.add("", 2000));
+    EXPECT_EQ(specials.token_of("<|ab|>"), 1004);
+    
+    std::mt19937 rng(4);
+    for (int round = 0; round < 2000; ++round) {
+        std::string text;
+        for (size_t n = rng() % 20; n > 0; --n) text += "<|ab>xy"[rng() % 7];
+        const size_t from = text.empty() ? 0 : rng() % text.size();
+        const auto expected = naive_find(patterns, text, from);
+        const auto found = specials.find(text, from);
+        ASSERT_EQ(found.has_value(), expected.has_value()) << text;
+        if (found) {
+            EXPECT_EQ(found->begin, expected->begin) << text;
+            EXPECT_EQ(found->length, expected->length) << text;
+            EXPECT_EQ(found->token, expected->token) << text;
+        }
+    }
+}
+
+// Test allowed, disallowed and ordinary handling, and decoding
+TEST(SpecialTokensTest, EncodeWithSpecial) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("hello world, hello there", 270);
+    EXPECT_THROW(tokenizer.add_special_token("<|bad|>", 260), std::invalid_argument);
+    tokenizer.add_special_token("<|endoftext|>", 100257);
+    tokenizer.add_special_token("<|im_start|>", 100264);
+    EXPECT_THROW(tokenizer.add_special_token("<|endoftext|>", 100300), std::invalid_argument);
+    EXPECT_EQ(tokenizer.special_token("<|im_start|>"), 100264);
+    EXPECT_EQ(tokenizer.special_tokens().size(), 2u);
+    
+    const std::string text = "<|im_start|>hello<|endoftext|> world<|endoftext|>";
+    tknzr::TokenList expected = {100264};
+    for (tknzr::Token t : tokenizer.encode("hello")) expected.push_back(t);
+    expected.push_back(100257);
+    for (tknzr::Token t : tokenizer.encode(" world")) expected.push_back(t);
+    expected.push_back(100257);
+    
+    const auto tokens = tokenizer.encode_with_special(text);
+    EXPECT_EQ(tokens, expected);
+    EXPECT_EQ(tokenizer.decode(tokens), text);
+    
+    // Not allowed and not disallowed: ordinary text, same as encode()
+    EXPECT_EQ(tokenizer.encode_with_special(text, tknzr::SpecialSet::none(), tknzr::SpecialSet::none()),
+              tokenizer.encode(text));
+    
+    // Allowing one and disallowing the rest
+    EXPECT_THROW(tokenizer.encode_with_special(text, {"<|endoftext|>"}), std::invalid_argument);
+    const auto partial = tokenizer.encode_with_special(text, {"<|endoftext|>"}, {"<|other|>"});
+    EXPECT_EQ(std::count(partial.begin(), partial.end(), 100257), 2);
+    EXPECT_EQ(std::count(partial.begin(), partial.end(), 100264), 0);
+    EXPECT_EQ(tokenizer.decode(partial), text);
+    
+    // A new vocabulary drops the special tokens
+    tokenizer.train("something else", 260);
+    EXPECT_FALSE(tokenizer.special_token("<|endoftext|>"));
+    EXPECT_EQ(tokenizer.encode_with_special("<|endoftext|>"), tokenizer.encode("<|endoftext|>"));
+}
+
+// Test that ids far past the vocabulary are refused before the id table grows
+TEST(SpecialTokensTest, RejectsIdsFarPastVocabulary) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("hello world, hello there", 270);
+    const tknzr::Token first_free = 256 + static_cast<tknzr::Token>(tokenizer.get_merges().size());
+    EXPECT_THROW(tokenizer.add_special_token("<|x|>", INT_MAX), std::invalid_argument);
+    EXPECT_THROW(tokenizer.add_special_token("<|x|>", first_free + tknzr::Tokenizer::kMaxSpecialGap),
+                 std::invalid_argument);
+    EXPECT_TRUE(tokenizer.special_tokens().empty());
+    EXPECT_EQ(tokenizer.token_width(), 2u);
+    
+    // The last id below the ceiling is fine, and real vocabularies fit easily
+    tokenizer.add_special_token("<|x|>", first_free + tknzr::Tokenizer::kMaxSpecialGap - 1);
+    tokenizer.add_special_token("<|endoftext|>", 199999);
+    EXPECT_EQ(tokenizer.decode({199999}), "<|endoftext|>");
+}
+
+// Test that compiled files keep the special tokens
+TEST(SpecialTokensTest, CompiledRoundTrip) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("hello world, hello there", 270);
+    tokenizer.add_special_token("<|endoftext|>", 300);
+    tokenizer.add_special_token("<|fim|>", 280);
+    
+    const std::string path = (std::filesystem::temp_directory_path() / "tknzr_special_test.bin").string();
+    ASSERT_TRUE(tokenizer.save_compiled(path));
+    tknzr::Tokenizer loaded;
+    ASSERT_TRUE(loaded.load_compiled(path));
+    EXPECT_EQ(loaded.special_token("<|endoftext|>"), 300);
+    EXPECT_EQ(loaded.special_token("<|fim|>"), 280);
+    
+    const std::string text = "hello<|fim|> there<|endoftext|>";
+    EXPECT_EQ(loaded.encode_with_special(text), tokenizer.encode_with_special(text));
+    EXPECT_EQ(loaded.decode(loaded.encode_with_special(text)), text);
+    
+    // Adding to a mapped tokenizer copies the table first
+    loaded.add_special_token("<|new|>", 400);
+    EXPECT_EQ(loaded.decode({400, 280}), "<|new|><|fim|>");
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,211 @@
+#include "tknzr/stream.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+static tknzr::Tokenizer trained_tokenizer(tknzr::SplitPattern pattern) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.set_split_pattern(pattern);
+    tokenizer.train("The quick brown fox jumps over the lazy dog. 12345 caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac  \n\n", 300);
+    return tokenizer;
+}
+
+// Random text mixing the character classes the split patterns care about,
+// including multi-byte letters and Unicode whitespace
+static std::string random_text(std::mt19937& rng, size_t pieces) {
+    static const std::vector<std::string> parts = {
+        "the", " fox", "  ", "   ", "\n", "\r\n", "\n\n", "1234567", " 42", "'s", "'LL", "!?", "...",
+        "caf\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac", "\xc2\xa0", "\xe3\x80\x80", "\xf0\x9f\x98\x80", "\t", "\xff",
+        "abcdefghij", "!!!!!!!!", "        ", "\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9",
+    };
+    std::string text;
+    for (size_t i = 0; i < pieces; ++i) text += parts[rng() % parts.size()];
+    return text;
+}
+
+// Test that any chunking of the input yields exactly the tokens of encode()
+TEST(StreamEncoderTest, ChunkingMatchesEncode) {
+    std::mt19937 rng(31);
+    for (auto pattern : {tknzr::SplitPattern::CL100K, tknzr::SplitPattern::GPT2}) {
+        const tknzr::Tokenizer tokenizer = trained_tokenizer(pattern);
+        tknzr::StreamEncoder encoder(tokenizer);
+        for (int round = 0; round < 200; ++round) {
+            const std::string text = random_text(rng, 1 + rng() % 40);
+            const size_t max_chunk = round % 4 == 0 ? 1 : 1 + rng() % 16;
+            
+            tknzr::TokenList tokens;
+            for (size_t pos = 0; pos < text.size();) {
+                const size_t length = std::min<size_t>(1 + rng() % max_chunk, text.size() - pos);
+                encoder.write(std::string_view(text).substr(pos, length), tokens);
+                pos += length;
+            }
+            encoder.finish(tokens);
+            EXPECT_EQ(tokens, tokenizer.encode(text)) << text;
+            EXPECT_EQ(encoder.buffered(), 0u);
+        }
+    }
+}
+
+// Test chunks cut inside whitespace and newline runs, which a later newline
+// can regroup (cl100k's \s*[\r\n]+, both patterns' \s+(?!\S)), and inside
+// contractions
+TEST(StreamEncoderTest, ChunksCutInsideWhitespaceRuns) {
+    std::string corpus;
+    for (int i = 0; i < 50; ++i) corpus += "x\n \ny x  \n\ny\r\n\t\nit'll we'll ";
+    std::mt19937 rng(13);
+    static const std::vector<std::string> parts = {"x", "y", "it", "'ll", "'", "l", " ", "  ", "\n", "\r", "\t",
+                                                   "\xc2\xa0"};
+    for (auto pattern : {tknzr::SplitPattern::CL100K, tknzr::SplitPattern::GPT2}) {
+        tknzr::Tokenizer tokenizer;
+        tokenizer.set_split_pattern(pattern);
+        tokenizer.train(corpus, 300);
+        tknzr::StreamEncoder encoder(tokenizer);
+        auto stream = [&](const std::string& text, size_t cut) {
+            tknzr::TokenList tokens;
+            encoder.write(std::string_view(text).substr(0, cut), tokens);
+            encoder.write(std::string_view(text).substr(cut), tokens);
+            encoder.finish(tokens);
+            return tokens;
+        };
+    
+        EXPECT_EQ(stream("x\n \ny", 3), tokenizer.encode("x\n \ny"));
+        EXPECT_EQ(stream("it'll", 3), tokenizer.encode("it'll"));
+        for (int round = 0; round < 300; ++round) {
+            std::string text;
+            for (size_t i = 1 + rng() % 12; i > 0; --i) text += parts[rng() % parts.size()];
+            const tknzr::TokenList expected = tokenizer.encode(text);
+            for (size_t cut = 0; cut <= text.size(); ++cut) {
+                EXPECT_EQ(stream(text, cut), expected) << cut << " in \"" << text << '"';
+            }
+        }
+    }
+}
+
+// Test that only the trailing piece is held back
+TEST(StreamEncoderTest, HoldsBackOnlyTrailingPiece) {
+    const tknzr::Tokenizer tokenizer = trained_tokenizer(tknzr::SplitPattern::CL100K);
+    tknzr::StreamEncoder encoder(tokenizer);
+    tknzr::TokenList tokens;
+    
+    encoder.write("The quick brown fo", tokens);
+    EXPECT_EQ(encoder.buffered(), 3u);  // " fo"
+    EXPECT_EQ(tokens, tokenizer.encode("The quick brown"));
+    
+    // Half of a two-byte character stays buffered along with the piece before it
+    encoder.write("x caf\xc3", tokens);
+    EXPECT_EQ(encoder.buffered(), 5u);  // " caf\xc3"
+    encoder.finish(tokens);
+    EXPECT_EQ(tokens, tokenizer.encode("The quick brown fox caf\xc3"));
+}
+
+// Test that a long piece fed in small chunks is not rescanned on every write:
+// streaming must stay within a small factor of one encode() of the text
+TEST(StreamEncoderTest, LongPieceInSmallChunks) {
+    using Clock = std::chrono::steady_clock;
+    const std::vector<std::pair<tknzr::SplitPattern, std::string>> cases = {
+        {tknzr::SplitPattern::CL100K, std::string(200000, 'a')},
+        {tknzr::SplitPattern::CL100K, std::string(200000, ' ')},
+        {tknzr::SplitPattern::CL100K, std::string(200000, '!')},
+        {tknzr::SplitPattern::GPT2, std::string(200000, '7')},
+        {tknzr::SplitPattern::GPT2, std::string(200000, '\n')},
+    };
+    for (const auto& [pattern, run] : cases) {
+        const tknzr::Tokenizer tokenizer = trained_tokenizer(pattern);
+        for (const std::string& text : {run, "x " + run + "\xc3\xa9" + run.substr(0, 20)}) {
+            Clock::time_point start = Clock::now();
+            const tknzr::TokenList expected = tokenizer.encode(text);
+            const double encode_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    
+            tknzr::StreamEncoder encoder(tokenizer);
+            tknzr::TokenList tokens;
+            start = Clock::now();
+            for (size_t pos = 0; pos < text.size(); pos += 15) {
+                encoder.write(std::string_view(text).substr(pos, 15), tokens);
+            }
+            encoder.finish(tokens);
+            const double stream_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    
+            EXPECT_EQ(tokens, expected) << static_cast<int>(run[0]);
+            // Rescanning the held-back piece on every write takes seconds here
+            EXPECT_LT(stream_seconds, 5 * encode_seconds + 0.25) << static_cast<int>(run[0]);
+        }
+    }
+}
+
+// Reference: replace every byte that does not start a valid UTF-8 sequence
+static std::string sanitize(const std::string& bytes) {
+    std::string out;
+    size_t i = 0;
+    while (i < bytes.size()) {
+        const auto at = [&](size_t k) { return static_cast<unsigned char>(bytes[k]); };
+        const unsigned char lead = at(i);
+        size_t length = lead < 0x80 ? 1 : lead >= 0xC2 && lead <= 0xDF ? 2
+                      : lead >= 0xE0 && lead <= 0xEF ? 3 : lead >= 0xF0 && lead <= 0xF4 ? 4 : 0;
+        bool valid = length > 0 && i + length <= bytes.size();
+        for (size_t k = 1; valid && k < length; ++k) {
+            unsigned char lo = 0x80, hi = 0xBF;
+            if (k == 1 && lead == 0xE0) lo = 0xA0;
+            if (k == 1 && lead == 0xED) hi = 0x9F;
+            if (k == 1 && lead == 0xF0) lo = 0x90;
+            if (k == 1 && lead == 0xF4) hi = 0x8F;
+            valid = at(i + k) >= lo && at(i + k) <= hi;
+        }
+        if (valid) {
+            out.append(bytes, i, length);
+            i += length;
+        } else {
+            out += "\xEF\xBF\xBD";
+            i++;
+        }
+    }
+    return out;
+}
+
+// Test that token-by-token decoding matches sanitizing the whole decode,
+// including tokens that split characters and invalid byte sequences
+TEST(StreamDecoderTest, TokenByTokenMatchesWholeDecode) {
+    const tknzr::Tokenizer tokenizer = trained_tokenizer(tknzr::SplitPattern::CL100K);
+    std::mt19937 rng(8);
+    tknzr::StreamDecoder decoder(tokenizer);
+    for (int round = 0; round < 500; ++round) {
+        tknzr::TokenList tokens;
+        if (round % 2 == 0) {
+            tokens = tokenizer.encode(random_text(rng, 1 + rng() % 20));
+        }
+        // Raw bytes, learned tokens and truncated characters in any order
+        for (size_t n = rng() % 12; n > 0; --n) {
+            const unsigned r = rng() % 4;
+            tokens.push_back(r == 0 ? 0x80 + rng() % 0x80 : r == 1 ? 0xC0 + rng() % 0x40 : rng() % 300);
+        }
+        std::shuffle(tokens.begin(), tokens.end(), rng);
+        
+        std::string text;
+        for (tknzr::Token token : tokens) {
+            const size_t before = text.size();
+            decoder.write(token, text);
+            EXPECT_EQ(sanitize(text.substr(before)), text.substr(before));
+            EXPECT_LE(decoder.buffered(), 3u);
+        }
+        decoder.finish(text);
+        EXPECT_EQ(text, sanitize(tokenizer.decode(tokens)));
+    }
+}
+
+// Test that a character split across tokens is emitted once it is complete
+TEST(StreamDecoderTest, CarriesSplitCharacter) {
+    tknzr::Tokenizer tokenizer;
+    tknzr::StreamDecoder decoder(tokenizer);
+    std::string text;
+    decoder.write(0xE6, text);  // First byte of U+65E5
+    decoder.write(0x97, text);
+    EXPECT_EQ(text, "");
+    EXPECT_EQ(decoder.buffered(), 2u);
+    decoder.write(std::vector<tknzr::Token>{0xA5, 'a', 0xC3}, text);
+    EXPECT_EQ(text, "\xe6\x97\xa5" "a");
+    decoder.finish(text);
+    EXPECT_EQ(text, "\xe6\x97\xa5" "a\xEF\xBF\xBD");
+}
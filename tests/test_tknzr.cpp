@@ -1,8 +1,19 @@
 #include "tknzr/tknzr.hpp"
+#include "tknzr/trainer.hpp"
+#include "thread_pool.hpp"
 #include <gtest/gtest.h>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+#include <atomic>
+#include <thread>
+#include <filesystem>
+#include <map>
+#include <fstream>
 
 // Test basic tokenizer creation
 TEST(TokenizerTest, BasicCreation) {
@@ -220,8 +231,839 @@ TEST(TokenizerTest, TiktokenBinaryFormat) {
     EXPECT_EQ(merges.at(257), std::make_pair(258, 259));
 }
 
+// Test that merges whose expansions keep doubling fail the load
+TEST(TokenizerTest, RejectsExplodingVocabulary) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("abababab", 258);
+    const tknzr::TokenList before = tokenizer.encode("abab");
+    
+    // Token 256 is "aa" and each later token doubles the previous one
+    std::vector<uint8_t> binary_data = {'a', 0, 'a', 0};
+    for (uint16_t token = 256; token < 256 + 40; ++token) {
+        for (int i = 0; i < 2; ++i) {
+            binary_data.push_back(token & 0xFF);
+            binary_data.push_back(token >> 8);
+        }
+    }
+    EXPECT_FALSE(tokenizer.load_from_tiktoken_binary(binary_data));
+    EXPECT_EQ(tokenizer.encode("abab"), before);
+    EXPECT_EQ(tokenizer.decode(before), "abab");
+    
+    // A short chain is fine
+    binary_data.resize(4 * 10);
+    EXPECT_TRUE(tokenizer.load_from_tiktoken_binary(binary_data));
+    EXPECT_EQ(tokenizer.decode({256 + 9}), std::string(1024, 'a'));
+}
+
+static std::string base64_encode(std::string_view bytes) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        uint32_t word = static_cast<unsigned char>(bytes[i]) << 16;
+        if (i + 1 < bytes.size()) word |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+        if (i + 2 < bytes.size()) word |= static_cast<unsigned char>(bytes[i + 2]);
+        out += alphabet[word >> 18];
+        out += alphabet[(word >> 12) & 63];
+        out += i + 1 < bytes.size() ? alphabet[(word >> 6) & 63] : '=';
+        out += i + 2 < bytes.size() ? alphabet[word & 63] : '=';
+    }
+    return out;
+}
+
+// Test loading the tiktoken text format, including a reordered byte alphabet
+TEST(TokenizerTest, TiktokenTextFormat) {
+    const std::string text = "the tiktoken format lists every token's bytes with its rank; the ranks are the ids";
+    tknzr::Tokenizer trained;
+    trained.train(text, 320);
+    
+    // Byte b gets rank 255 - b, as tiktoken files order bytes their own way;
+    // lines are shuffled since only the ranks matter
+    std::vector<std::string> lines;
+    for (int b = 0; b < 256; ++b) {
+        lines.push_back(base64_encode(std::string(1, static_cast<char>(b))) + " " + std::to_string(255 - b));
+    }
+    for (const auto& [token, pair] : trained.get_merges()) {
+        lines.push_back(base64_encode(trained.decode({token})) + " " + std::to_string(token));
+    }
+    std::shuffle(lines.begin(), lines.end(), std::mt19937(19));
+    std::string file;
+    for (const std::string& line : lines) file += line + "\r\n";
+    
+    tknzr::Tokenizer loaded;
+    ASSERT_TRUE(loaded.load_tiktoken(file));
+    EXPECT_EQ(loaded.vocab_size(), trained.vocab_size());
+    EXPECT_EQ(loaded.decode({0}), "\xff");
+    
+    tknzr::TokenList expected = trained.encode(text);
+    for (tknzr::Token& token : expected) {
+        if (token < 256) token = 255 - token;
+    }
+    EXPECT_EQ(loaded.encode(text), expected);
+    EXPECT_EQ(loaded.decode(loaded.encode(text)), text);
+    
+    // load_from_file detects the format, and compiled files keep the byte order
+    const std::string path = (std::filesystem::temp_directory_path() / "tknzr_test.tiktoken").string();
+    std::ofstream(path, std::ios::binary) << file;
+    tknzr::Tokenizer from_file;
+    ASSERT_TRUE(from_file.load_from_file(path));
+    EXPECT_EQ(from_file.encode(text), expected);
+    ASSERT_TRUE(from_file.save_compiled(path));
+    tknzr::Tokenizer compiled;
+    ASSERT_TRUE(compiled.load_compiled(path));
+    EXPECT_EQ(compiled.encode(text), expected);
+    std::filesystem::remove(path);
+    
+    // Malformed files are rejected and leave the tokenizer as it was
+    EXPECT_FALSE(loaded.load_tiktoken(file + "YWJj x\n"));
+    EXPECT_FALSE(loaded.load_tiktoken(file + "YW*j 999\n"));
+    EXPECT_FALSE(loaded.load_tiktoken(file + base64_encode("th") + " 9999\n"));
+    EXPECT_FALSE(loaded.load_tiktoken(file.substr(0, file.find('\n') + 1)));
+    EXPECT_EQ(loaded.encode(text), expected);
+}
+
 // Test GPT-4 default vocabulary size
 TEST(TokenizerTest, GPT4DefaultVocabSize) {
     tknzr::Tokenizer tokenizer; // Default should be 100256 for GPT-4
     EXPECT_EQ(tokenizer.vocab_size(), 100256);
 }
+
+// Reference BPE: repeatedly apply the lowest ranked pair present anywhere in
+// the word, left to right, until no learned pair remains.
+static tknzr::TokenList reference_bpe(const tknzr::Tokenizer& tokenizer, const std::string& text) {
+    std::vector<std::pair<int, tknzr::Pair>> ranked;
+    for (const auto& [token_id, pair] : tokenizer.get_merges()) {
+        ranked.emplace_back(token_id - 256, pair);
+    }
+    std::sort(ranked.begin(), ranked.end());
+    
+    tknzr::TokenList word = tknzr::convert_bytestream_to_vector(text);
+    for (bool merged = true; merged && word.size() > 1;) {
+        merged = false;
+        for (const auto& [rank, pair] : ranked) {
+            auto next = tknzr::swap_pairs_with_value(word, pair, 256 + rank);
+            if (next.size() != word.size()) {
+                word = std::move(next);
+                merged = true;
+                break;
+            }
+        }
+    }
+    return word;
+}
+
+// Test that the priority-queue merge engine matches the reference algorithm
+TEST(TokenizerTest, MergeEngineMatchesReference) {
+    std::mt19937 rng(1234);
+    const std::string alphabet = "ab c\n";
+    auto random_text = [&](size_t len) {
+        std::string s;
+        for (size_t i = 0; i < len; ++i) s += alphabet[rng() % alphabet.size()];
+        return s;
+    };
+    
+    for (int round = 0; round < 20; ++round) {
+        tknzr::Tokenizer tokenizer;
+        tokenizer.set_split_pattern(tknzr::SplitPattern::None);
+        tokenizer.train(random_text(400), 256 + 40);
+        for (int i = 0; i < 20; ++i) {
+            std::string text = random_text(1 + rng() % 64);
+            EXPECT_EQ(tokenizer.encode(text), reference_bpe(tokenizer, text)) << text;
+        }
+    }
+    
+    // Runs of a single byte exercise overlapping candidates of equal rank
+    tknzr::Tokenizer tokenizer;
+    tokenizer.set_split_pattern(tknzr::SplitPattern::None);
+    tokenizer.train(std::string(100, 'a'), 300);
+    for (size_t len = 1; len < 40; ++len) {
+        std::string text(len, 'a');
+        EXPECT_EQ(tokenizer.encode(text), reference_bpe(tokenizer, text)) << len;
+    }
+}
+
+// Reference trainer: recount every pair after each merge and pick the highest
+// count, breaking ties by the smallest (first, second) pair.
+static std::vector<tknzr::Pair> reference_train(const std::string& text, int vocab_size) {
+    std::vector<tknzr::Pair> merges;
+    tknzr::TokenList word = tknzr::convert_bytestream_to_vector(text);
+    for (int token = 256; token < vocab_size; ++token) {
+        auto counts = tknzr::create_pairs(word);
+        if (counts.empty()) break;
+        auto best = std::min_element(counts.begin(), counts.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        merges.push_back(best->first);
+        word = tknzr::swap_pairs_with_value(word, best->first, token);
+    }
+    return merges;
+}
+
+static std::vector<tknzr::Pair> learned_merges(const tknzr::Tokenizer& tokenizer) {
+    std::vector<tknzr::Pair> merges;
+    for (const auto& [token_id, pair] : tokenizer.get_merges()) merges.push_back(pair);
+    return merges;
+}
+
+// Test that the incremental trainer learns exactly the reference merges
+TEST(TrainerTest, MatchesReferenceTrainer) {
+    std::mt19937 rng(99);
+    const std::string alphabet = "aab c\n";
+    for (int round = 0; round < 20; ++round) {
+        std::string text;
+        for (size_t i = 0, n = 1 + rng() % 500; i < n; ++i) text += alphabet[rng() % alphabet.size()];
+    
+        tknzr::Tokenizer tokenizer;
+        tokenizer.train(text, 256 + 60);
+        EXPECT_EQ(learned_merges(tokenizer), reference_train(text, 256 + 60)) << text;
+    }
+}
+
+// Test that training keeps going past pairs of byte 0 and stops when no pair is left
+TEST(TrainerTest, RunsUntilNoPairRemains) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train(std::string(64, '\0'), 1000);
+    EXPECT_EQ(tokenizer.vocab_size(), 256 + 6);  // 64 -> 32 -> ... -> 1
+    EXPECT_EQ(tokenizer.encode(std::string(64, '\0')).size(), 1u);
+}
+
+// Reference piece trainer: the same tie-break as reference_train, run over a
+// table of unique pieces weighted by how often they occur
+static std::vector<tknzr::Pair> reference_train_pieces(const std::string& text, int vocab_size,
+                                                       tknzr::SplitPattern pattern = tknzr::SplitPattern::CL100K) {
+    std::map<std::string_view, uint64_t> counts;
+    for (std::string_view piece : tknzr::PreTokenizer(pattern).split(text)) counts[piece]++;
+    std::vector<std::pair<tknzr::TokenList, uint64_t>> words;
+    for (const auto& [piece, count] : counts) {
+        words.emplace_back(tknzr::convert_bytestream_to_vector(std::string(piece)), count);
+    }
+    
+    std::vector<tknzr::Pair> merges;
+    for (int token = 256; token < vocab_size; ++token) {
+        std::map<tknzr::Pair, uint64_t> pairs;
+        for (const auto& [word, count] : words) {
+            for (size_t i = 0; i + 1 < word.size(); ++i) pairs[{word[i], word[i + 1]}] += count;
+        }
+        if (pairs.empty()) break;
+        auto best = pairs.begin();
+        for (auto it = pairs.begin(); it != pairs.end(); ++it) {
+            if (it->second > best->second) best = it;
+        }
+        merges.push_back(best->first);
+        for (auto& [word, count] : words) word = tknzr::swap_pairs_with_value(word, best->first, token);
+    }
+    return merges;
+}
+
+// Test that piece training matches the reference, independent of thread
+// count and of how long documents are cut into chunks
+TEST(TrainerTest, PieceTrainingMatchesReference) {
+    const std::vector<std::string> words = {"the", "cat", "sat", "on", "mat", "it's", "42", "1999", "\u00e9t\u00e9"};
+    const std::vector<std::string> separators = {" ", "  ", ", ", ".\n", "\n\n", "\n", "! "};
+    std::mt19937 rng(7);
+    std::string text;
+    while (text.size() < (3u << 19)) {
+        text += words[rng() % words.size()];
+        text += separators[rng() % separators.size()];
+    }
+    
+    // The text is longer than one chunk, so it is cut for counting
+    for (auto pattern : {tknzr::SplitPattern::CL100K, tknzr::SplitPattern::GPT2}) {
+        const auto expected = reference_train_pieces(text, 256 + 40, pattern);
+        for (size_t threads : {1, 4}) {
+            tknzr::Tokenizer tokenizer;
+            tokenizer.set_split_pattern(pattern);
+            tokenizer.set_num_threads(threads);
+            std::string_view whole = text;
+            tokenizer.train_pieces(std::span(&whole, 1), 256 + 40);
+            EXPECT_EQ(learned_merges(tokenizer), expected) << threads;
+            EXPECT_EQ(tokenizer.decode(tokenizer.encode(text.substr(0, 1000))), text.substr(0, 1000));
+        }
+    
+        // Splitting the corpus into documents where a piece begins changes nothing
+        const size_t cut = tknzr::PreTokenizer(pattern).boundary_after(text, text.size() / 2);
+        const std::vector<std::string_view> documents = {std::string_view(text).substr(0, cut),
+                                                         std::string_view(text).substr(cut)};
+        tknzr::Tokenizer tokenizer;
+        tokenizer.set_split_pattern(pattern);
+        tokenizer.train_pieces(documents, 256 + 40);
+        EXPECT_EQ(learned_merges(tokenizer), expected);
+    }
+}
+
+// Test that a memory-capped trainer spills to disk and still learns the same
+// merges from files, chunks and document iterators
+TEST(TrainerTest, StreamingTrainerSpillsAndMatches) {
+    std::mt19937 rng(21);
+    std::vector<std::string> documents;
+    for (int i = 0; i < 300; ++i) {
+        std::string document;
+        for (int j = 0; j < 40; ++j) {
+            document += " w" + std::to_string(rng() % 500);
+            if (rng() % 8 == 0) document += ".\n";
+        }
+        documents.push_back(document);
+    }
+    std::vector<std::string_view> views(documents.begin(), documents.end());
+    
+    tknzr::Tokenizer expected;
+    expected.train_pieces(views, 256 + 50);
+    
+    const std::string path = (std::filesystem::temp_directory_path() / "tknzr_trainer_test.txt").string();
+    {
+        std::ofstream out(path, std::ios::binary);
+        for (size_t i = 0; i < 100; ++i) out << documents[i];
+    }
+    
+    tknzr::Trainer trainer(tknzr::SplitPattern::CL100K, 4096);
+    trainer.set_num_threads(2);
+    ASSERT_TRUE(trainer.add_file(path));
+    for (size_t i = 100; i < 200; ++i) trainer.add_chunk(documents[i]);
+    trainer.add_documents(documents.begin() + 200, documents.end());
+    EXPECT_GT(trainer.spill_count(), 1u);
+    EXPECT_FALSE(trainer.add_file(path + ".missing"));
+    
+    tknzr::Tokenizer tokenizer;
+    tokenizer.set_split_pattern(tknzr::SplitPattern::None);
+    trainer.train(tokenizer, 256 + 50);
+    EXPECT_EQ(tokenizer.split_pattern(), tknzr::SplitPattern::CL100K);
+    EXPECT_EQ(learned_merges(tokenizer), learned_merges(expected));
+    EXPECT_EQ(tokenizer.encode(documents[0]), expected.encode(documents[0]));
+    std::filesystem::remove(path);
+}
+
+// Test that a run resumed from a checkpoint learns the same merges as an
+// uninterrupted run, and that damaged checkpoints are rejected
+TEST(TrainerTest, ResumeFromCheckpoint) {
+    std::mt19937 rng(5);
+    std::vector<std::string> documents;
+    for (int i = 0; i < 200; ++i) {
+        std::string document;
+        for (int j = 0; j < 30; ++j) document += " v" + std::to_string(rng() % 300) + (j % 7 ? "" : ",\n");
+        documents.push_back(document);
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "tknzr_checkpoint_test.ckpt").string();
+    
+    tknzr::Tokenizer expected;
+    {
+        tknzr::Trainer trainer(tknzr::SplitPattern::GPT2);
+        trainer.add_documents(documents.begin(), documents.end());
+        trainer.train(expected, 256 + 80);
+    }
+    
+    // "Killed" after 30 merges, with periodic checkpoints along the way
+    {
+        tknzr::Trainer trainer(tknzr::SplitPattern::GPT2);
+        trainer.add_documents(documents.begin(), documents.end());
+        trainer.set_checkpoint(path, 10);
+        tknzr::Tokenizer partial;
+        trainer.train(partial, 256 + 30);
+        EXPECT_GE(trainer.checkpoints_written(), 1u);
+    }
+    
+    tknzr::Trainer resumed;
+    ASSERT_TRUE(resumed.resume(path));
+    EXPECT_THROW(resumed.add_chunk("more"), std::logic_error);
+    tknzr::Tokenizer tokenizer;
+    resumed.train(tokenizer, 256 + 80);
+    EXPECT_EQ(tokenizer.split_pattern(), tknzr::SplitPattern::GPT2);
+    EXPECT_EQ(learned_merges(tokenizer), learned_merges(expected));
+    
+    // Flip one payload byte
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    bytes[bytes.size() / 2] ^= 1;
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << bytes;
+    }
+    tknzr::Trainer corrupt;
+    EXPECT_FALSE(corrupt.resume(path));
+    EXPECT_FALSE(corrupt.resume(path + ".missing"));
+    std::filesystem::remove(path);
+}
+
+// Test resuming from a background snapshot taken while training was still
+// running, not just from the final checkpoint
+TEST(TrainerTest, ResumeFromPeriodicSnapshot) {
+    std::mt19937 rng(12);
+    std::vector<std::string> documents;
+    for (int i = 0; i < 400; ++i) {
+        std::string document;
+        for (int j = 0; j < 40; ++j) document += " w" + std::to_string(rng() % 5000) + (j % 9 ? "" : ".\n");
+        documents.push_back(document);
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "tknzr_snapshot_test.ckpt").string();
+    const int vocab_size = 256 + 600;
+    std::filesystem::remove(path);
+    
+    tknzr::Tokenizer expected;
+    {
+        tknzr::Trainer trainer;
+        trainer.add_documents(documents.begin(), documents.end());
+        trainer.train(expected, vocab_size);
+    }
+    
+    // Copy the checkpoint file while training runs and keep the latest
+    // snapshot short of the end (header field merge_count is at offset 56)
+    auto read_file = [](const std::string& file) {
+        std::ifstream in(file, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    };
+    auto merge_count = [](const std::string& bytes) {
+        uint64_t count = 0;
+        if (bytes.size() >= 64) std::memcpy(&count, bytes.data() + 56, sizeof(count));
+        return count;
+    };
+    std::string snapshot;
+    std::atomic<bool> done{false};
+    std::thread watcher([&] {
+        while (!done.load()) {
+            const std::string bytes = read_file(path);
+            const uint64_t count = merge_count(bytes);
+            if (count > merge_count(snapshot) && count < static_cast<uint64_t>(vocab_size - 256)) snapshot = bytes;
+            std::this_thread::yield();
+        }
+    });
+    {
+        tknzr::Trainer trainer;
+        trainer.add_documents(documents.begin(), documents.end());
+        trainer.set_checkpoint(path, 1);
+        tknzr::Tokenizer full;
+        trainer.train(full, vocab_size);
+        EXPECT_GT(trainer.checkpoints_written(), 1u);
+    }
+    done = true;
+    watcher.join();
+    ASSERT_FALSE(snapshot.empty()) << "no snapshot observed before training finished";
+    
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << snapshot;
+    }
+    tknzr::Trainer resumed;
+    ASSERT_TRUE(resumed.resume(path));
+    tknzr::Tokenizer tokenizer;
+    resumed.train(tokenizer, vocab_size);
+    EXPECT_EQ(learned_merges(tokenizer), learned_merges(expected)) << merge_count(snapshot);
+    std::filesystem::remove(path);
+}
+
+// Test the frozen merge index lookups
+TEST(MergeIndexTest, LookupAndPairs) {
+    tknzr::MergeIndex index;
+    index.build({{97, 98}, {256, 99}, {97, 98}});
+    
+    const auto* merge = index.find(256, 99);
+    ASSERT_NE(merge, nullptr);
+    EXPECT_EQ(merge->rank, 1);
+    EXPECT_EQ(merge->token, 257);
+    
+    // A repeated pair keeps its last rank, as the map-based index did
+    merge = index.find(97, 98);
+    ASSERT_NE(merge, nullptr);
+    EXPECT_EQ(merge->rank, 2);
+    EXPECT_EQ(index.find(98, 97), nullptr);
+    
+    ASSERT_NE(index.pair_of(256), nullptr);
+    EXPECT_EQ(*index.pair_of(256), std::make_pair(97, 98));
+    EXPECT_EQ(index.pair_of(255), nullptr);
+    EXPECT_EQ(index.pair_of(259), nullptr);
+    EXPECT_EQ(index.size(), 3);
+}
+
+// Test that small token ids no longer collide in PairHash
+TEST(PairHashTest, SmallIdsDistinct) {
+    tknzr::PairHash hasher;
+    std::unordered_set<size_t> hashes;
+    for (int a = 0; a < 64; ++a) {
+        for (int b = 0; b < 64; ++b) {
+            hashes.insert(hasher({a, b}));
+        }
+    }
+    EXPECT_EQ(hashes.size(), 64u * 64u);
+}
+
+// Test that the encode cache returns identical tokens and counts hits
+TEST(EncodeCacheTest, HitsMatchUncached) {
+    tknzr::Tokenizer tokenizer;
+    std::string text = "the cat and the dog and the bird";
+    tokenizer.train(text, 320);
+    auto expected = tokenizer.encode(text);
+    
+    tokenizer.enable_cache(1 << 20);
+    EXPECT_EQ(tokenizer.encode(text), expected);
+    auto first = tokenizer.cache_stats();
+    EXPECT_GT(first.misses, 0u);
+    EXPECT_GT(first.hits, 0u); // " the" and " and" repeat within the text
+    
+    EXPECT_EQ(tokenizer.encode(text), expected);
+    auto second = tokenizer.cache_stats();
+    EXPECT_EQ(second.misses, first.misses);
+    EXPECT_GT(second.hits, first.hits);
+    
+    // Retraining must not serve encodings from the old vocabulary
+    tokenizer.train("zzzz", 260);
+    EXPECT_EQ(tokenizer.cache_stats().entries, 0u);
+    EXPECT_EQ(tokenizer.decode(tokenizer.encode(text)), text);
+    
+    tokenizer.disable_cache();
+    EXPECT_EQ(tokenizer.cache_stats().budget_bytes, 0u);
+}
+
+// Test that the cache stays within its memory budget
+TEST(EncodeCacheTest, EvictsWithinBudget) {
+    tknzr::EncodeCache cache(4096, 4);
+    std::vector<tknzr::Token> tokens = {1, 2, 3};
+    for (int i = 0; i < 1000; ++i) {
+        cache.insert("piece" + std::to_string(i), tokens);
+    }
+    auto stats = cache.stats();
+    EXPECT_LE(stats.bytes, 4096u);
+    EXPECT_GT(stats.evictions, 0u);
+    EXPECT_GT(stats.entries, 0u);
+    
+    std::vector<tknzr::Token> out;
+    EXPECT_TRUE(cache.lookup("piece999", out));
+    EXPECT_EQ(out, tokens);
+    EXPECT_FALSE(cache.lookup("piece0", out));
+}
+
+// Test concurrent encodes against one const tokenizer while the cache fills
+TEST(EncodeCacheTest, ConcurrentEncode) {
+    tknzr::Tokenizer tokenizer;
+    std::string corpus = "lorem ipsum dolor sit amet, consectetur adipiscing elit 0123456789";
+    tokenizer.train(corpus, 350);
+    
+    std::vector<std::string> texts;
+    std::vector<tknzr::TokenList> expected;
+    for (int i = 0; i < 32; ++i) {
+        texts.push_back(corpus.substr(i % 7) + " " + std::to_string(i * 7919));
+        expected.push_back(tokenizer.encode(texts.back()));
+    }
+    
+    tokenizer.enable_cache(16 << 10);
+    const tknzr::Tokenizer& shared = tokenizer;
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < 50; ++round) {
+                size_t i = (t * 5 + round) % texts.size();
+                if (shared.encode(texts[i]) != expected[i]) ++mismatches;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    
+    EXPECT_EQ(mismatches.load(), 0);
+    EXPECT_GT(tokenizer.cache_stats().hits, 0u);
+}
+
+// Test that a task calling back into its own pool runs the inner job inline
+TEST(BatchTest, NestedParallelForDoesNotDeadlock) {
+    tknzr::ThreadPool pool(4);
+    std::vector<size_t> order(16);
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::vector<std::atomic<int>> runs(order.size() * order.size());
+    pool.parallel_for(order, [&](size_t outer, size_t) {
+        pool.parallel_for(order, [&](size_t inner, size_t) { ++runs[outer * order.size() + inner]; });
+    });
+    for (const auto& count : runs) EXPECT_EQ(count.load(), 1);
+}
+
+// Test that batch encoding matches per-document encoding for any thread count
+TEST(BatchTest, EncodeBatchMatchesEncode) {
+    tknzr::Tokenizer tokenizer;
+    std::string corpus = "It was the best of times, it was the worst of times; 1,234,567 reasons.";
+    tokenizer.train(corpus, 360);
+    
+    // Heavily skewed sizes: one large document among many short ones
+    std::vector<std::string> docs;
+    for (int i = 0; i < 40; ++i) {
+        docs.push_back(corpus.substr(i % 20, 5 + i));
+    }
+    std::string large;
+    for (int i = 0; i < 500; ++i) large += corpus;
+    docs.insert(docs.begin() + 7, large);
+    docs.push_back("");
+    std::vector<std::string_view> views(docs.begin(), docs.end());
+    
+    for (size_t threads : {1, 2, 4}) {
+        tokenizer.set_num_threads(threads);
+        EXPECT_EQ(tokenizer.num_threads(), threads);
+    
+        auto batch = tokenizer.encode_batch(views);
+        ASSERT_EQ(batch.size(), docs.size());
+        for (size_t i = 0; i < docs.size(); ++i) {
+            auto expected = tokenizer.encode(docs[i]);
+            EXPECT_TRUE(std::equal(batch[i].begin(), batch[i].end(), expected.begin(), expected.end())) << i;
+        }
+    
+        auto decoded = tokenizer.decode_batch(batch);
+        ASSERT_EQ(decoded.size(), docs.size());
+        for (size_t i = 0; i < docs.size(); ++i) {
+            EXPECT_EQ(decoded[i], docs[i]);
+        }
+    }
+    
+    tokenizer.set_num_threads(0);
+    EXPECT_GE(tokenizer.num_threads(), 1u);
+    EXPECT_EQ(tokenizer.encode_batch({}).size(), 0u);
+}
+
+// Test that encoding one text in parallel chunks matches encoding it whole
+TEST(BatchTest, EncodeParallelMatchesEncode) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("It was the best of times, it was the worst of times; 1,234,567 reasons.", 360);
+    tokenizer.set_num_threads(4);
+    
+    std::mt19937 rng(23);
+    const std::vector<std::string> parts = {"the", " times", "  ", "\n", "\r\n ", "1234", "'s", "'ll", "...",
+                                            "caf\xc3\xa9", " \xe6\x97\xa5", "\xc2\xa0", "\xff", "\t", "x"};
+    for (auto pattern : {tknzr::SplitPattern::CL100K, tknzr::SplitPattern::GPT2, tknzr::SplitPattern::None}) {
+        tokenizer.set_split_pattern(pattern);
+        for (int round = 0; round < 20; ++round) {
+            std::string text;
+            for (size_t n = rng() % 3000; n > 0; --n) text += parts[rng() % parts.size()];
+            const tknzr::TokenList expected = tokenizer.encode(text);
+            for (size_t chunk : {1, 7, 64, 1000, 1 << 20}) {
+                EXPECT_EQ(tokenizer.encode_parallel(text, chunk), expected) << chunk;
+            }
+        }
+    }
+    EXPECT_TRUE(tokenizer.encode_parallel("").empty());
+}
+
+// Test that counting always agrees with the size of the encoding
+TEST(BatchTest, CountTokensMatchesEncode) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("the cat sat on the mat, the dog sat on the log. 2024-01-01", 320);
+    tokenizer.set_num_threads(3);
+    
+    std::mt19937 rng(3);
+    std::vector<std::string> texts = {"", "a", "the cat", std::string(1000, ' ')};
+    for (int i = 0; i < 50; ++i) {
+        std::string text;
+        for (size_t n = rng() % 200; n > 0; --n) text += static_cast<char>(rng() % 128 == 0 ? 0xC3 : " acdeghlmnost.,0123"[rng() % 19]);
+        texts.push_back(text);
+    }
+    std::vector<std::string_view> views(texts.begin(), texts.end());
+    
+    const auto counts = tokenizer.count_tokens_batch(views);
+    ASSERT_EQ(counts.size(), texts.size());
+    for (size_t i = 0; i < texts.size(); ++i) {
+        EXPECT_EQ(tokenizer.count_tokens(texts[i]), tokenizer.encode(texts[i]).size());
+        EXPECT_EQ(counts[i], tokenizer.encode(texts[i]).size());
+    }
+    tokenizer.enable_cache();
+    for (const auto& text : texts) {
+        EXPECT_EQ(tokenizer.count_tokens(text), tokenizer.encode(text).size());
+    }
+}
+
+// Test that truncated encodes equal the matching end of the full encoding
+TEST(TokenizerTest, EncodeTruncated) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("the cat sat on the mat, the dog sat on the log. 2024-01-01", 320);
+    
+    std::mt19937 rng(16);
+    for (int round = 0; round < 100; ++round) {
+        std::string text;
+        for (size_t n = rng() % 300; n > 0; --n) text += " acdeghlmnost.,0123\n"[rng() % 20];
+        const tknzr::TokenList full = tokenizer.encode(text);
+        for (size_t limit : {size_t{0}, size_t{1}, size_t{7}, full.size() / 2, full.size(), full.size() + 5}) {
+            const size_t kept = std::min(limit, full.size());
+            EXPECT_EQ(tokenizer.encode_truncated(text, limit),
+                      tknzr::TokenList(full.begin(), full.begin() + kept));
+            EXPECT_EQ(tokenizer.encode_truncated(text, limit, tknzr::TruncationSide::Tail),
+                      tknzr::TokenList(full.end() - kept, full.end()));
+        }
+    }
+}
+
+// Test that windows cover the encoding, stay within size and match encoding
+// their byte range alone
+TEST(TokenizerTest, EncodeWindows) {
+    tknzr::Tokenizer tokenizer;
+    tokenizer.train("the cat sat on the mat, the dog sat on the log. 2024-01-01", 320);
+    EXPECT_THROW(tokenizer.encode_windows("abc", 0, 1), std::invalid_argument);
+    EXPECT_TRUE(tokenizer.encode_windows("", 4, 2).windows.empty());
+    
+    std::mt19937 rng(17);
+    for (auto pattern : {tknzr::SplitPattern::CL100K, tknzr::SplitPattern::GPT2}) {
+        tokenizer.set_split_pattern(pattern);
+        tokenizer.train("the cat sat on the mat,\n\nthe dog sat on the log.  2024-01-01\n\n", 320);
+    
+        // Under GPT2 "\n\n" splits as "\n" "\n" before "y" but not alone
+        const std::string repro = "x\n\ny";
+        const tknzr::WindowedEncoding edge = tokenizer.encode_windows(repro, 2, 1);
+        for (size_t i = 0; i < edge.size(); ++i) {
+            const tknzr::TokenWindow& w = edge.windows[i];
+            const tknzr::TokenList tokens(edge[i].begin(), edge[i].end());
+            EXPECT_EQ(tokens, tokenizer.encode(repro.substr(w.byte_begin, w.byte_end - w.byte_begin))) << i;
+        }
+    
+        for (int round = 0; round < 100; ++round) {
+            std::string text;
+            for (size_t n = 1 + rng() % 300; n > 0; --n) text += " acdeghlmnost.,0123\n"[rng() % 20];
+            if (round % 10 == 0) text += " " + std::string(60, 'q');  // One piece longer than a window
+            const size_t window = 4 + rng() % 20;
+            const size_t stride = 1 + rng() % window;
+    
+            const tknzr::WindowedEncoding windows = tokenizer.encode_windows(text, window, stride);
+            EXPECT_EQ(windows.tokens, tokenizer.encode(text));
+            ASSERT_FALSE(windows.windows.empty());
+            EXPECT_EQ(windows.windows.front().token_begin, 0u);
+            EXPECT_EQ(windows.windows.back().token_end, windows.tokens.size());
+            for (size_t i = 0; i < windows.size(); ++i) {
+                const tknzr::TokenWindow& w = windows.windows[i];
+                EXPECT_LE(w.token_end - w.token_begin, window);
+                if (i > 0) {
+                    EXPECT_GT(w.token_begin, windows.windows[i - 1].token_begin);
+                    EXPECT_LE(w.token_begin, windows.windows[i - 1].token_end);  // No gaps
+                }
+                const std::string bytes = text.substr(w.byte_begin, w.byte_end - w.byte_begin);
+                const tknzr::TokenList tokens(windows[i].begin(), windows[i].end());
+                EXPECT_EQ(tokenizer.decode(tokens), bytes);
+                if (bytes.find("qqqq") == std::string::npos) {
+                    EXPECT_EQ(tokens, tokenizer.encode(bytes)) << bytes;
+                }
+            }
+        }
+    }
+}
+
+// Test decode_into and the flat byte table on edge cases
+TEST(TokenizerTest, DecodeInto) {
+    tknzr::Tokenizer tokenizer;
+    std::string text = "abcabcabc";
+    
+    // Untrained tokenizers still decode byte tokens
+    EXPECT_EQ(tokenizer.decode({'h', 'i'}), "hi");
+    
+    tokenizer.train(text, 300);
+    auto tokens = tokenizer.encode(text);
+    std::string out = "previous contents";
+    tokenizer.decode_into(tokens, out);
+    EXPECT_EQ(out, text);
+    
+    // Unknown ids decode to nothing
+    tokens.push_back(-1);
+    tokens.push_back(1 << 20);
+    tokenizer.decode_into(tokens, out);
+    EXPECT_EQ(out, text);
+    
+    // Forward and self references in loaded merges do not recurse forever
+    std::vector<uint8_t> binary = {1, 1, 'x', 0, 'a', 0, 'b', 0, 0, 1, 0, 1};
+    ASSERT_TRUE(tokenizer.load_from_tiktoken_binary(binary));
+    EXPECT_EQ(tokenizer.decode({257}), "ab");
+    EXPECT_EQ(tokenizer.decode({256}), "abx");
+    EXPECT_EQ(tokenizer.decode({258}), "abxabx");
+}
+
+// Test saving and memory-mapping a compiled tokenizer
+TEST(CompiledTest, SaveAndLoadRoundTrip) {
+    tknzr::Tokenizer trained;
+    std::string text = "compiled tokenizers load in place: compiled, mapped, shared";
+    trained.set_split_pattern(tknzr::SplitPattern::GPT2);
+    trained.train(text, 330);
+    
+    const std::string path = (std::filesystem::temp_directory_path() / "tknzr_test.tkc").string();
+    ASSERT_TRUE(trained.save_compiled(path));
+    
+    tknzr::Tokenizer loaded;
+    ASSERT_TRUE(loaded.load_compiled(path));
+    EXPECT_EQ(loaded.vocab_size(), trained.vocab_size());
+    EXPECT_EQ(loaded.split_pattern(), tknzr::SplitPattern::GPT2);
+    EXPECT_TRUE(std::equal(loaded.get_merges().begin(), loaded.get_merges().end(),
+                           trained.get_merges().begin(), trained.get_merges().end()));
+    EXPECT_EQ(loaded.encode(text), trained.encode(text));
+    EXPECT_EQ(loaded.decode(loaded.encode(text)), text);
+    
+    // Copies keep the mapping alive and stay usable
+    tknzr::Tokenizer copy = loaded;
+    loaded = tknzr::Tokenizer();
+    EXPECT_EQ(copy.encode(text), trained.encode(text));
+    
+    // load_from_file recognizes the compiled format
+    tknzr::Tokenizer from_file;
+    ASSERT_TRUE(from_file.load_from_file(path));
+    EXPECT_EQ(from_file.encode(text), trained.encode(text));
+    
+    std::filesystem::remove(path);
+}
+
+// Test that corrupted compiled files are rejected
+TEST(CompiledTest, RejectsCorruptFiles) {
+    tknzr::Tokenizer trained;
+    trained.train("checksum checksum checksum", 280);
+    const std::string path = (std::filesystem::temp_directory_path() / "tknzr_corrupt.tkc").string();
+    ASSERT_TRUE(trained.save_compiled(path));
+    
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto write = [&](const std::string& data) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+    };
+    
+    std::string flipped = bytes;
+    flipped[flipped.size() - 3] ^= 0x40;
+    write(flipped);
+    tknzr::Tokenizer tokenizer;
+    EXPECT_FALSE(tokenizer.load_compiled(path));
+    EXPECT_FALSE(tokenizer.load_from_file(path));
+    
+    write(bytes.substr(0, bytes.size() / 2));
+    EXPECT_FALSE(tokenizer.load_compiled(path, false));
+    EXPECT_FALSE(tokenizer.load_compiled(path + ".missing"));
+    
+    // Unchecked files with a broken slot table or span section must still
+    // fail instead of hanging or reading out of range
+    auto field = [&](const std::string& data, size_t offset) {
+        uint64_t value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        return value;
+    };
+    const size_t slot_count = field(bytes, 56);
+    const size_t slots_offset = field(bytes, 80);
+    using Slot = tknzr::MergeIndex::Slot;
+    std::vector<Slot> slots(slot_count);
+    std::memcpy(slots.data(), bytes.data() + slots_offset, slot_count * sizeof(Slot));
+    const auto used = std::find_if(slots.begin(), slots.end(),
+                                   [](const Slot& slot) { return slot.key != tknzr::MergeIndex::kEmptyKey; });
+    ASSERT_NE(used, slots.end());
+    
+    std::string full = bytes;  // No empty slot: a miss would probe forever
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (slots[i].key == tknzr::MergeIndex::kEmptyKey) {
+            std::memcpy(full.data() + slots_offset + i * sizeof(Slot), &*used, sizeof(Slot));
+        }
+    }
+    write(full);
+    EXPECT_FALSE(tokenizer.load_compiled(path, false));
+    
+    std::string bad_rank = bytes;
+    Slot slot = *used;
+    slot.entry.rank = 1 << 20;
+    std::memcpy(bad_rank.data() + slots_offset + (used - slots.begin()) * sizeof(Slot), &slot, sizeof(Slot));
+    write(bad_rank);
+    EXPECT_FALSE(tokenizer.load_compiled(path, false));
+    
+    std::string few_spans = bytes;
+    const uint64_t span_count = 200;
+    std::memcpy(few_spans.data() + 64, &span_count, sizeof(span_count));
+    write(few_spans);
+    EXPECT_FALSE(tokenizer.load_compiled(path, false));
+    
+    write(bytes);
+    EXPECT_TRUE(tokenizer.load_compiled(path, false));
+    
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,299 @@
+#include "encode_job.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace tknzr::encode_job {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int kManifestVersion = 1;
+constexpr size_t kWriteChunk = 16u << 20;  // Bytes buffered per output file before each write
+
+std::string unescape(std::string_view text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            switch (text[++i]) {
+                case 'n': out += '\n'; continue;
+                case 'r': out += '\r'; continue;
+                case 't': out += '\t'; continue;
+                case '\\': out += '\\'; continue;
+                default: out += '\\'; break;
+            }
+        }
+        out += text[i];
+    }
+    return out;
+}
+
+} // namespace
+
+// Output file written in large sequential chunks (declared in the header
+// only so ShardWriter can hold it)
+class ChunkedFile {
+public:
+    explicit ChunkedFile(const fs::path& path) : path_(path), file_(std::fopen(path.string().c_str(), "wb")) {
+        if (!file_) throw std::runtime_error("cannot create " + path.string());
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+        buffer_.reserve(kWriteChunk);
+    }
+    ~ChunkedFile() {
+        if (file_) std::fclose(file_);
+    }
+    
+    ChunkedFile(const ChunkedFile&) = delete;
+    ChunkedFile& operator=(const ChunkedFile&) = delete;
+    
+    // Append value as `width` little-endian bytes
+    void put(uint64_t value, size_t width) {
+        for (size_t i = 0; i < width; ++i) {
+            buffer_.push_back(static_cast<char>(value >> (8 * i)));
+        }
+        if (buffer_.size() >= kWriteChunk) flush();
+    }
+    
+    void close() {
+        flush();
+        const bool failed = std::fclose(file_) != 0;
+        file_ = nullptr;
+        if (failed) throw std::runtime_error("cannot write " + path_.string());
+    }
+
+private:
+    void flush() {
+        if (!buffer_.empty() && std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+            throw std::runtime_error("cannot write " + path_.string());
+        }
+        buffer_.clear();
+    }
+    
+    fs::path path_;
+    std::FILE* file_;
+    std::string buffer_;
+};
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--tokenizer" && has_value) {
+            options.tokenizer = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            options.out = argv[++i];
+        } else if (arg == "--pattern" && has_value) {
+            const std::string name = argv[++i];
+            if (name == "cl100k") options.pattern = SplitPattern::CL100K;
+            else if (name == "gpt2") options.pattern = SplitPattern::GPT2;
+            else if (name == "none") options.pattern = SplitPattern::None;
+            else return false;
+        } else if (arg == "--separator" && has_value) {
+            options.separator = unescape(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--width" && has_value) {
+            options.width = std::strtoull(argv[++i], nullptr, 10);
+            if (options.width != 2 && options.width != 4) return false;
+        } else if (arg == "--shard-mb" && has_value) {
+            options.shard_bytes = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1) << 20;
+        } else if (arg == "--batch-mb" && has_value) {
+            options.batch_bytes = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1) << 20;
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.inputs.push_back(arg);
+        } else {
+            return false;
+        }
+    }
+    return !options.tokenizer.empty() && !options.out.empty() && !options.inputs.empty();
+}
+
+std::vector<std::string> list_inputs(const std::vector<std::string>& inputs) {
+    std::vector<std::string> files;
+    for (const std::string& input : inputs) {
+        if (!fs::is_directory(input)) {
+            files.push_back(input);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (const auto& entry : fs::recursive_directory_iterator(input)) {
+            if (entry.is_regular_file()) found.push_back(entry.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+// FNV-1a, so a resumed run can tell it is continuing the same job
+std::string job_fingerprint(const std::vector<std::string>& files, const Options& options,
+                            const Tokenizer& tokenizer, size_t width) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&](std::string_view bytes) {
+        for (unsigned char c : bytes) {
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        }
+        hash = (hash ^ 0xff) * 0x100000001b3ULL;
+    };
+    for (const std::string& file : files) {
+        mix(file);
+        mix(std::to_string(fs::file_size(file)));
+    }
+    mix(options.separator);
+    mix(std::to_string(width));
+    mix(std::to_string(static_cast<int>(tokenizer.split_pattern())));
+    mix(std::to_string(tokenizer.vocab_size()));
+    // The vocabulary itself: byte mapping, merges and special tokens
+    for (Token token = 0; token < 256; ++token) mix(tokenizer.decode({token}));
+    for (const auto& [token, pair] : tokenizer.get_merges()) {
+        mix(std::to_string(pair.first) + ' ' + std::to_string(pair.second));
+    }
+    for (const auto& [text, token] : tokenizer.special_tokens()) {
+        mix(text);
+        mix(std::to_string(token));
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
+
+std::string shard_name(size_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "shard-%05zu", index);
+    return name;
+}
+
+ShardWriter::ShardWriter(const Options& options, size_t width, size_t next_shard,
+                         std::function<void(const ShardStats&)> on_finished)
+    : dir_(options.out),
+      width_(width),
+      shard_bytes_(options.shard_bytes),
+      next_shard_(next_shard),
+      on_finished_(std::move(on_finished)) {}
+
+ShardWriter::~ShardWriter() = default;
+
+void ShardWriter::append(const BatchEncoding& batch, Cursor after) {
+    if (!tokens_) open();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        for (Token token : batch[i]) tokens_->put(static_cast<uint32_t>(token), width_);
+        shard_tokens_ += batch[i].size();
+        index_->put(shard_tokens_, sizeof(uint64_t));
+    }
+    shard_documents_ += batch.size();
+    if (shard_tokens_ * width_ >= shard_bytes_) finish(after);
+}
+
+void ShardWriter::finish(Cursor after) {
+    if (!tokens_) return;
+    const std::string name = shard_name(next_shard_);
+    tokens_->close();
+    index_->close();
+    tokens_.reset();
+    index_.reset();
+    fs::rename(dir_ / (name + ".tokens.tmp"), dir_ / (name + ".tokens"));
+    fs::rename(dir_ / (name + ".index.tmp"), dir_ / (name + ".index"));
+    
+    std::ofstream manifest(dir_ / "manifest.txt", std::ios::app);
+    manifest << "shard " << next_shard_ << " documents " << shard_documents_ << " tokens " << shard_tokens_
+             << " next " << after.file << ' ' << after.offset << '\n';
+    if (!manifest.flush()) throw std::runtime_error("cannot update the manifest");
+    if (on_finished_) on_finished_(ShardStats{next_shard_, shard_documents_, shard_tokens_});
+    total_tokens_ += shard_tokens_;
+    ++next_shard_;
+}
+
+void ShardWriter::open() {
+    const std::string name = shard_name(next_shard_);
+    tokens_ = std::make_unique<ChunkedFile>(dir_ / (name + ".tokens.tmp"));
+    index_ = std::make_unique<ChunkedFile>(dir_ / (name + ".index.tmp"));
+    index_->put(0, sizeof(uint64_t));
+    shard_tokens_ = 0;
+    shard_documents_ = 0;
+}
+
+std::pair<Cursor, size_t> open_manifest(const fs::path& dir, const std::string& fingerprint, size_t width) {
+    const fs::path path = dir / "manifest.txt";
+    std::ifstream in(path);
+    std::string line;
+    // A header cut off by a crash means no shard was finished either
+    if (!in || !std::getline(in, line) || in.eof()) {
+        in.close();
+        std::ofstream out(path, std::ios::trunc);
+        out << "tknzr-encode " << kManifestVersion << " job " << fingerprint << " width " << width << '\n';
+        if (!out.flush()) throw std::runtime_error("cannot create " + path.string());
+        return {Cursor{}, 0};
+    }
+    
+    std::istringstream header(line);
+    std::string tool, job_word, job, width_word;
+    int version = 0;
+    size_t stored_width = 0;
+    header >> tool >> version >> job_word >> job >> width_word >> stored_width;
+    if (tool != "tknzr-encode" || version != kManifestVersion || job != fingerprint || stored_width != width) {
+        throw std::runtime_error(dir.string() + " holds the output of a different job");
+    }
+    
+    // Lines are only trusted whole: one without its newline was cut off
+    Cursor cursor;
+    size_t shards = 0;
+    std::streamoff valid_end = in.tellg();
+    while (std::getline(in, line) && !in.eof()) {
+        std::istringstream fields(line);
+        std::string shard_word, documents_word, tokens_word, next_word;
+        size_t index = 0;
+        uint64_t documents = 0, tokens = 0;
+        Cursor next;
+        if (!(fields >> shard_word >> index >> documents_word >> documents >> tokens_word >> tokens >> next_word >>
+                  next.file >> next.offset) || shard_word != "shard" || index != shards) {
+            break;
+        }
+        cursor = next;
+        ++shards;
+        valid_end = in.tellg();
+    }
+    in.close();
+    if (fs::file_size(path) != static_cast<uintmax_t>(valid_end)) {
+        fs::resize_file(path, static_cast<uintmax_t>(valid_end));
+    }
+    return {cursor, shards};
+}
+
+Batch next_batch(const std::vector<std::string>& files, Cursor& cursor, const Options& options) {
+    Batch batch;
+    while (cursor.file < files.size() && batch.bytes < options.batch_bytes) {
+        auto mapping = MappedFile::open(files[cursor.file]);
+        if (!mapping) throw std::runtime_error("cannot read " + files[cursor.file]);
+        const std::string_view text = mapping->bytes();
+    
+        while (cursor.offset < text.size() || (cursor.offset == 0 && text.empty())) {
+            size_t end = text.size();
+            size_t next = text.size();
+            if (!options.separator.empty()) {
+                const size_t found = text.find(options.separator, cursor.offset);
+                if (found != std::string_view::npos) {
+                    end = found;
+                    next = found + options.separator.size();
+                }
+            }
+            // Only a trailing separator's empty remainder is not a document
+            if (end > cursor.offset || next < text.size() || text.empty()) {
+                batch.documents.push_back(text.substr(cursor.offset, end - cursor.offset));
+                batch.bytes += end - cursor.offset;
+            }
+            cursor.offset = next;
+            if (text.empty() || batch.bytes >= options.batch_bytes) break;
+        }
+        batch.mappings.push_back(std::move(mapping));
+        if (cursor.offset >= text.size()) cursor = Cursor{cursor.file + 1, 0};
+    }
+    batch.end = cursor;
+    return batch;
+}
+
+} // namespace tknzr::encode_job
@@ -0,0 +1,143 @@
+#pragma once
+#include "tknzr/tknzr.hpp"
+#include "tknzr/mapped_file.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Job logic of tknzr-encode: inputs, documents, shards and the manifest.
+// Kept apart from main() so resuming can be tested without running the tool.
+
+namespace tknzr::encode_job {
+
+    struct Options {
+        std::string tokenizer;
+        std::string out;
+        std::vector<std::string> inputs;
+        std::optional<SplitPattern> pattern;
+        std::string separator;  // Empty: one document per file
+        size_t threads = 0;
+        size_t width = 0;  // Bytes per token, 0 picks the smallest that fits
+        size_t shard_bytes = size_t{1} << 30;
+        size_t batch_bytes = size_t{64} << 20;
+    };
+
+    /**
+     * Position in the input: the next unread byte of one file
+     */
+    struct Cursor {
+        size_t file = 0;
+        size_t offset = 0;
+    };
+
+    /**
+     * Documents of one batch; views point into the mappings, which live as
+     * long as the batch
+     */
+    struct Batch {
+        std::vector<std::unique_ptr<MappedFile>> mappings;
+        std::vector<std::string_view> documents;
+        size_t bytes = 0;
+        Cursor end;
+    };
+
+    /**
+     * Parse the command line
+     * @return false on an unknown or malformed option, or a missing input
+     */
+    bool parse_options(int argc, char** argv, Options& options);
+
+    /**
+     * Expand directories into the regular files below them, in name order
+     */
+    std::vector<std::string> list_inputs(const std::vector<std::string>& inputs);
+
+    /**
+     * Hash of everything that decides the output: the input files and their
+     * sizes, the separator, the token width and the tokenizer's pattern,
+     * byte mapping, merges and special tokens
+     */
+    std::string job_fingerprint(const std::vector<std::string>& files, const Options& options,
+                                const Tokenizer& tokenizer, size_t width);
+
+    /**
+     * Read or start dir/manifest.txt
+     * Finished shards are read up to the first incomplete or out-of-order
+     * line, and anything after them is cut off so new lines append cleanly.
+     * @return Position to resume from and the number of finished shards
+     * @throws std::runtime_error if the manifest belongs to a different job
+     */
+    std::pair<Cursor, size_t> open_manifest(const std::filesystem::path& dir, const std::string& fingerprint,
+                                            size_t width);
+
+    /**
+     * Read documents from cursor on until the batch holds options.batch_bytes
+     * bytes or the input ends, advancing cursor past them
+     * @throws std::runtime_error if an input file cannot be read
+     */
+    Batch next_batch(const std::vector<std::string>& files, Cursor& cursor, const Options& options);
+
+    /**
+     * What one finished shard holds
+     */
+    struct ShardStats {
+        size_t index;
+        uint64_t documents;
+        uint64_t tokens;
+    };
+
+    class ChunkedFile;
+
+    /**
+     * Fills shards batch by batch; a shard is closed, renamed into place and
+     * recorded in the manifest once it reaches the target size
+     */
+    class ShardWriter {
+    public:
+        /**
+         * @param on_finished Called with each shard once it is recorded, e.g.
+         *                    to report progress; may be empty
+         */
+        ShardWriter(const Options& options, size_t width, size_t next_shard,
+                    std::function<void(const ShardStats&)> on_finished = {});
+        ~ShardWriter();
+
+        ShardWriter(const ShardWriter&) = delete;
+        ShardWriter& operator=(const ShardWriter&) = delete;
+
+        void append(const BatchEncoding& batch, Cursor after);
+
+        /**
+         * Close the open shard, if any
+         */
+        void finish(Cursor after);
+
+        uint64_t total_tokens() const noexcept { return total_tokens_; }
+
+    private:
+        void open();
+
+        std::filesystem::path dir_;
+        size_t width_;
+        size_t shard_bytes_;
+        size_t next_shard_;
+        std::function<void(const ShardStats&)> on_finished_;
+        std::unique_ptr<ChunkedFile> tokens_;
+        std::unique_ptr<ChunkedFile> index_;
+        uint64_t shard_tokens_ = 0;
+        uint64_t shard_documents_ = 0;
+        uint64_t total_tokens_ = 0;
+    };
+
+    /**
+     * Base name of shard `index`, e.g. "shard-00003"
+     */
+    std::string shard_name(size_t index);
+}
@@ -0,0 +1,127 @@
+// tknzr-encode: tokenize files and directories into packed token shards
+//
+// Every input file is memory-mapped and cut into documents (the whole file,
+// or the text between separators). Documents are encoded in parallel, a
+// batch at a time, while the previous batch is written out. Each shard is
+// a pair of files in the output directory:
+//
+//   shard-NNNNN.tokens  token ids as little-endian uint16 or uint32
+//   shard-NNNNN.index   little-endian uint64 token offsets: 0, then the end
+//                       of each document
+//
+// manifest.txt records the job and one line per finished shard, with the
+// input position after it. Running the same command again resumes after
+// the last finished shard; a partly written shard, or a manifest line cut
+// off by a crash, is simply redone.
+
+#include "encode_job.hpp"
+#include "tknzr/tknzr.hpp"
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+namespace fs = std::filesystem;
+using tknzr::encode_job::Batch;
+using tknzr::encode_job::Options;
+using tknzr::encode_job::ShardWriter;
+using Clock = std::chrono::steady_clock;
+
+void usage() {
+    std::cerr << "usage: tknzr-encode --tokenizer FILE --out DIR [options] INPUT...\n"
+                 "  INPUT                 file, or directory read recursively in name order\n"
+                 "  --pattern NAME        cl100k, gpt2 or none (default: the tokenizer's)\n"
+                 "  --separator TEXT      split files into documents at TEXT (\\n escapes allowed)\n"
+                 "  --threads N           encoding threads (default: all cores)\n"
+                 "  --width 2|4           bytes per token (default: smallest that fits the vocabulary)\n"
+                 "  --shard-mb N          target shard size in MiB (default 1024)\n"
+                 "  --batch-mb N          input text encoded per batch in MiB (default 64)\n";
+}
+
+// Many documents spread over the pool; a few large ones are each split
+tknzr::BatchEncoding encode(const tknzr::Tokenizer& tokenizer, const Batch& batch) {
+    if (batch.documents.size() >= tokenizer.num_threads()) {
+        return tokenizer.encode_batch(batch.documents);
+    }
+    tknzr::BatchEncoding encoded;
+    encoded.offsets.push_back(0);
+    for (std::string_view document : batch.documents) {
+        const tknzr::TokenList tokens = tokenizer.encode_parallel(document);
+        encoded.tokens.insert(encoded.tokens.end(), tokens.begin(), tokens.end());
+        encoded.offsets.push_back(encoded.tokens.size());
+    }
+    return encoded;
+}
+
+int run(const Options& options) {
+    tknzr::Tokenizer tokenizer;
+    if (!tokenizer.load_from_file(options.tokenizer)) {
+        throw std::runtime_error("cannot load tokenizer " + options.tokenizer);
+    }
+    if (options.pattern) tokenizer.set_split_pattern(*options.pattern);
+    tokenizer.set_num_threads(options.threads);
+    
+    const size_t needed = tokenizer.token_width();
+    const size_t width = options.width ? options.width : needed;
+    if (width < needed) {
+        throw std::runtime_error("--width " + std::to_string(width) + " cannot hold " +
+                                 std::to_string(tokenizer.vocab_size()) + " token ids");
+    }
+    
+    const std::vector<std::string> files = tknzr::encode_job::list_inputs(options.inputs);
+    fs::create_directories(options.out);
+    const std::string fingerprint = tknzr::encode_job::job_fingerprint(files, options, tokenizer, width);
+    auto [cursor, shards] = tknzr::encode_job::open_manifest(options.out, fingerprint, width);
+    if (shards > 0) {
+        std::cerr << "resuming after " << shards << " shards at file " << cursor.file << " of " << files.size() << '\n';
+    }
+    
+    // Batch n + 1 is encoded while batch n is being written
+    ShardWriter writer(options, width, shards, [](const tknzr::encode_job::ShardStats& shard) {
+        std::cerr << tknzr::encode_job::shard_name(shard.index) << ": " << shard.documents << " documents, "
+                  << shard.tokens << " tokens\n";
+    });
+    std::future<void> writing;
+    uint64_t bytes = 0;
+    const Clock::time_point start = Clock::now();
+    while (cursor.file < files.size()) {
+        Batch batch = tknzr::encode_job::next_batch(files, cursor, options);
+        tknzr::BatchEncoding encoded = encode(tokenizer, batch);
+        bytes += batch.bytes;
+        if (writing.valid()) writing.get();
+        writing = std::async(std::launch::async, [&writer, encoded = std::move(encoded), end = batch.end] {
+            writer.append(encoded, end);
+        });
+    }
+    if (writing.valid()) writing.get();
+    writer.finish(cursor);
+    
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cerr << "encoded " << bytes << " bytes into " << writer.total_tokens() << " tokens in " << seconds
+              << " s (" << (seconds > 0 ? static_cast<double>(bytes) / seconds / (1 << 20) : 0.0) << " MiB/s)\n";
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!tknzr::encode_job::parse_options(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+    try {
+        return run(options);
+    } catch (const std::exception& e) {
+        std::cerr << "tknzr-encode: " << e.what() << '\n';
+        return 1;
+    }
+}